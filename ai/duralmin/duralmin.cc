@@ -1,7 +1,10 @@
 #include <algorithm>
+#include <atomic>
 #include <limits>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <gflags/gflags.h>
@@ -11,10 +14,14 @@
 #include "../../simulator/board.h"
 #include "../../simulator/game.h"
 #include "../../simulator/hexpoint.h"
+#include "../../simulator/scorer.h"
 #include "../../simulator/solver.h"
+#include "../../simulator/thread_pool.h"
 #include "../../simulator/unit.h"
 
 DEFINE_int32(duralmin_depth, 0, "depth");
+DEFINE_int32(duralmin_table_size, 1 << 18,
+             "Max entries in the transposition table.");
 
 template<typename T>
 std::string DumpV(const std::vector<T>& seq) {
@@ -27,13 +34,11 @@ std::string DumpV(const std::vector<T>& seq) {
 
 class Duralmin : public Solver {
 public:
-  Duralmin() {}
+  Duralmin() : max_unit_size_(0), pool_(FLAGS_threads) {}
   virtual ~Duralmin() {}
 
-  static int64_t Score(const Game& game, std::ostream& os) {
-    const Board& board(game.board());
-    std::vector<int> height(GetHeightLine(game));
-    int hole;
+  static int CountHoles(const Board& board, const std::vector<int>& height) {
+    int hole = 0;
     for (int i = 0; i < board.width(); ++i) {
       for (int j = height[i] + 1; j < board.height(); ++j) {
         if (!board(i, j)) {
@@ -41,6 +46,13 @@ public:
         }
       }
     }
+    return hole;
+  }
+
+  static int64_t Score(const Game& game, std::ostream& os) {
+    const Board& board(game.board());
+    std::vector<int> height(GetHeightLine(game));
+    int hole = CountHoles(board, height);
 
     int64_t height_score = GetHeightPenalty(height);
     os << "height:" << DumpV(height) << "(score:" << height_score
@@ -56,6 +68,32 @@ public:
       2 * (height * width * height * 100 + height * width * 2000);
   }
 
+  // Returns an upper bound of Score() after placing |num_units| more units.
+  // The height penalty may drop to 0. Unless some line can be cleared
+  // meanwhile, holes go away only by being filled by the placed cells.
+  int64_t UpperBound(const Game& game, int num_units) const {
+    const Board& board(game.board());
+    const int num_cells = num_units * max_unit_size_;
+    for (int j = 0; j < board.height(); ++j) {
+      int empty = 0;
+      for (int i = 0; i < board.width(); ++i) {
+        if (!board(i, j)) {
+          ++empty;
+        }
+      }
+      if (empty <= num_cells) {
+        // A unit clears at most as many lines as its cells.
+        return game.score() + num_units * MoveScore(
+            max_unit_size_, max_unit_size_, max_unit_size_);
+      }
+    }
+    const int hole = CountHoles(board, GetHeightLine(game));
+    return game.score() +
+      MoveScore(max_unit_size_, 0, game.prev_cleared_lines()) +
+      (num_units - 1) * MoveScore(max_unit_size_, 0, 0) -
+      std::max(0, hole - num_cells) * 2000;
+  }
+
   typedef std::pair<HexPoint, int> UnitLocation;
 
   std::string DumpLocations(const std::vector<UnitLocation>& v) {
@@ -66,59 +104,220 @@ public:
     return os.str();
   }
 
-  int64_t Dfs(const Game& game, int depth,
-              int64_t prev_max_score,
-              std::vector<UnitLocation>* positions,
-              std::string* result_command) {
-    std::vector<Game::Command> ret;
+  // A placement of the current unit, and the game after it.
+  struct Child {
+    int index;  // In the ReachableUnits result.
+    Game game;
+    bool finished;
+    int64_t score;
+  };
+
+  // Places the current unit at each reachable location and scores the
+  // result. Unless |depth| is 0, the children are ordered by the score, so
+  // that searching the promising ones first raises alpha early.
+  void Expand(const Game& game, int depth,
+              std::vector<Game::SearchResult>* bfsresult,
+              std::vector<Child>* children) {
+    game.ReachableUnits(bfsresult);
+    children->resize(bfsresult->size());
+    for (int i = 0; i < bfsresult->size(); ++i) {
+      Child& child = (*children)[i];
+      child.index = i;
+      child.game = game;
+      child.finished = !child.game.PlaceUnit((*bfsresult)[i].first);
+      if (child.finished) {
+        child.score = MinScore(child.game);
+      } else {
+        std::ostringstream os;
+        child.score = Score(child.game, os);
+      }
+    }
+    if (depth > 0) {
+      std::stable_sort(children->begin(), children->end(),
+                       [](const Child& lhs, const Child& rhs) {
+                         return lhs.score > rhs.score;
+                       });
+    }
+  }
+
+  // Returns the best score among the leaves |depth| + 1 units below |game|.
+  // Subtrees which cannot reach |alpha| are pruned, so a result less than
+  // |alpha| only tells that the best is less than |alpha|.
+  int64_t Dfs(const Game& game, int depth, int64_t alpha,
+              std::vector<UnitLocation>* positions) {
+    // Scores from here on depend only on the state, so the table stores them
+    // relative to the score so far.
+    TableEntry entry;
+    if (table_.Find(game, depth, &entry)) {
+      const int64_t value = game.score() + entry.value;
+      if (entry.exact || value < alpha) {
+        return value;
+      }
+    }
+
     std::vector<Game::SearchResult> bfsresult;
-    game.ReachableUnits(&bfsresult);
+    std::vector<Child> children;
+    Expand(game, depth, &bfsresult, &children);
+
+    const int64_t initial_alpha = alpha;
     int64_t max_score = std::numeric_limits<int64_t>::min();
-    for(const auto &res: bfsresult) {
-      positions->emplace_back(res.first.pivot(), res.first.angle());
-      Game ng(game);
-      int64_t score = 0;
-      std::ostringstream os;
-      if (ng.RunSequence(res.second)) {
-        if (depth == 0) {
-          score = Score(ng, os);
-        } else {
-          score = Dfs(ng, depth - 1, prev_max_score, positions, nullptr);
+    for (const auto& child : children) {
+      const auto& res = bfsresult[child.index];
+      int64_t score = child.score;
+      if (depth > 0 && !child.finished) {
+        if (UpperBound(child.game, depth) < alpha) {
+          continue;
         }
-      } else {
-        score = MinScore(ng);
+        positions->emplace_back(res.first.pivot(), res.first.angle());
+        score = Dfs(child.game, depth - 1, alpha, positions);
+        positions->pop_back();
       }
       if (score > max_score) {
-        ret = res.second;
         max_score = score;
-        if (max_score > prev_max_score) {
-          VLOG(1) << "@" << DumpLocations(*positions)
-                  << " score:" << prev_max_score << " -> " << max_score;
-          VLOG(1) << "scorer:" << os.str();
-          prev_max_score = max_score;
+        if (max_score > alpha) {
+          VLOG(2) << "@" << DumpLocations(*positions)
+                  << res.first.pivot() << "/" << res.first.angle()
+                  << " score:" << alpha << " -> " << max_score;
+          alpha = max_score;
         }
       }
-      positions->pop_back();
-    }
-    if (result_command) {
-      *result_command = Game::Commands2SimpleString(ret);
     }
+
+    entry.exact = max_score >= initial_alpha;
+    entry.value = (entry.exact ? max_score : initial_alpha - 1) - game.score();
+    table_.Store(game, depth, entry);
     return max_score;
   }
 
+  // Searches the subtree of each first placement in parallel. They share
+  // the best score so far for pruning. Ties go to the placement found first
+  // by ReachableUnits, so the result does not depend on the timing.
   virtual std::string NextCommands(const Game& game) {
-    std::string result;
-    std::vector<UnitLocation> positions;
-    Dfs(game, FLAGS_duralmin_depth, std::numeric_limits<int64_t>::min(),
-        &positions, &result);
-    return result;
+    if (max_unit_size_ == 0) {
+      for (const auto& unit : game.units()) {
+        max_unit_size_ = std::max<int>(max_unit_size_, unit.members().size());
+      }
+    }
+    const int depth = FLAGS_duralmin_depth;
+    std::vector<Game::SearchResult> bfsresult;
+    std::vector<Child> children;
+    Expand(game, depth, &bfsresult, &children);
+
+    std::atomic<int64_t> alpha(std::numeric_limits<int64_t>::min());
+    std::vector<int64_t> scores(children.size());
+    // Not vector<bool>, whose elements share words between the threads.
+    std::vector<char> pruned(children.size(), false);
+    pool_.ParallelFor(children.size(), [&](int i) {
+        const Child& child = children[i];
+        int64_t score = child.score;
+        if (depth > 0 && !child.finished) {
+          if (UpperBound(child.game, depth) < alpha) {
+            pruned[i] = true;
+            return;
+          }
+          const auto& res = bfsresult[child.index];
+          std::vector<UnitLocation> positions;
+          positions.emplace_back(res.first.pivot(), res.first.angle());
+          score = Dfs(child.game, depth - 1, alpha, &positions);
+        }
+        scores[i] = score;
+        int64_t current = alpha;
+        while (score > current &&
+               !alpha.compare_exchange_weak(current, score)) {}
+      });
+
+    int64_t max_score = std::numeric_limits<int64_t>::min();
+    int best_index = -1;
+    for (int i = 0; i < children.size(); ++i) {
+      if (pruned[i]) {
+        continue;
+      }
+      if (scores[i] > max_score ||
+          (scores[i] == max_score && children[i].index < best_index)) {
+        max_score = scores[i];
+        best_index = children[i].index;
+      }
+    }
+    if (best_index < 0) {
+      return "";
+    }
+    const auto& best = bfsresult[best_index];
+    VLOG(1) << best.first.pivot() << "/" << best.first.angle()
+            << " score:" << max_score;
+    return Game::Commands2SimpleString(best.second);
   }
+
+private:
+  // Best score below a state, or an upper bound of it if not exact.
+  struct TableEntry {
+    int64_t value;
+    bool exact;
+  };
+
+  // Transposition table shared by the threads, keyed by the state of the
+  // game and the depth. Entries keep the state, so that a hash collision is
+  // a miss. Each shard is cleared when it gets full.
+  class Table {
+   public:
+    Table() {}
+
+    bool Find(const Game& game, int depth, TableEntry* entry) {
+      const size_t key = Key(game, depth);
+      Shard& shard = shards_[key % kNumShards];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.slots.find(key);
+      if (it == shard.slots.end() || it->second.depth != depth ||
+          !game.HasState(it->second.state)) {
+        return false;
+      }
+      *entry = it->second.entry;
+      return true;
+    }
+
+    void Store(const Game& game, int depth, const TableEntry& entry) {
+      const size_t key = Key(game, depth);
+      Shard& shard = shards_[key % kNumShards];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (shard.slots.size() >= FLAGS_duralmin_table_size / kNumShards) {
+        shard.slots.clear();
+      }
+      shard.slots[key] = Slot {game.GetStateKey(), depth, entry};
+    }
+
+   private:
+    static const int kNumShards = 16;
+    struct Slot {
+      Game::StateKey state;
+      int depth;
+      TableEntry entry;
+    };
+    struct Shard {
+      std::mutex mutex;
+      std::unordered_map<size_t, Slot> slots;
+    };
+
+    static size_t Key(const Game& game, int depth) {
+      return game.StateHash() * 1000003 + depth;
+    }
+
+    Shard shards_[kNumShards];
+
+    DISALLOW_COPY_AND_ASSIGN(Table);
+  };
+
+  int max_unit_size_;
+  Table table_;
+  ThreadPool pool_;
 };
 
+REGISTER_SOLVER(duralmin, "Duralmin", [] { return new Duralmin(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new Duralmin(), "Duralmin");
+  return RunSolver([] { return new Duralmin(); }, "Duralmin");
 }
+#endif  // SOLVER_HOST
@@ -1,16 +1,20 @@
 #include "duralstarman.h"
 
 #include <algorithm>
+#include <chrono>
 #include <limits>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "../../simulator/ai_util.h"
+#include "../../simulator/beam_state.h"
 #include "../../simulator/board.h"
 #include "../../simulator/game.h"
 #include "../../simulator/hexpoint.h"
@@ -19,65 +23,390 @@
 
 
 struct GameState {
-  Game game;
+  std::shared_ptr<const BeamState> state;
   bool finished;
   int64_t score;
   std::string command0;
   GameState() {}
-  GameState(const Game& game, bool finished, int64_t score)
-    : game(game), finished(finished), score(score) {}
+  GameState(const std::shared_ptr<const BeamState>& state, bool finished,
+            int64_t score)
+    : state(state), finished(finished), score(score) {}
 };
 
-bool by_score_descend(const std::unique_ptr<GameState>& lhs,
-                      const std::unique_ptr<GameState>& rhs) {
-  return lhs->score > rhs->score;
+// The number of states expanded at once. Candidates are held only for a
+// chunk at a time, which bounds the memory for them.
+static const int kExpandChunkSize = 16;
+
+// In the anytime mode, the width grows up to what fits in the memory limit,
+// or up to this times the base width if the limit is unknown.
+static const int kMaxAnytimeWidthFactor = 8;
+
+// A child of a state, scored on a scratch game but not materialized yet.
+struct Candidate {
+  int parent;
+  int index;  // Index in the parent's ReachableUnits result.
+  const SearchCache::Child* child;
+};
+
+// Strict order so that the selection does not depend on the sort algorithm.
+bool by_score_descend(const Candidate& lhs, const Candidate& rhs) {
+  if (lhs.child->score != rhs.child->score) {
+    return lhs.child->score > rhs.child->score;
+  }
+  if (lhs.parent != rhs.parent) {
+    return lhs.parent < rhs.parent;
+  }
+  return lhs.index < rhs.index;
+}
+
+// Returns whether placing the current unit of |game| at either location
+// gives the same state.
+static bool HaveSameChildState(const Game& game, const UnitLocation& lhs,
+                               const UnitLocation& rhs) {
+  Game lhs_game(game);
+  Game rhs_game(game);
+  lhs_game.PlaceUnit(lhs);
+  rhs_game.PlaceUnit(rhs);
+  return lhs_game.HasSameState(rhs_game);
+}
+
+// Rebuilds the game of a candidate into |game|.
+static void RestoreCandidate(
+    const std::vector<std::unique_ptr<GameState>>& states,
+    const Candidate& candidate, Game* game) {
+  states[candidate.parent]->state->Restore(game);
+  game->PlaceUnit(candidate.child->location);
+}
+
+// Keeps the best |width| candidates of the children of |states|. Among the
+// ones reaching the same position, only the best scored one is kept. Games
+// are compared only when the state hashes match, so that a collision does
+// not drop a candidate.
+void SelectCandidates(const std::vector<std::unique_ptr<GameState>>& states,
+                      std::vector<Candidate>* candidates, int width) {
+  sort(candidates->begin(), candidates->end(), by_score_descend);
+  std::unordered_map<size_t, size_t> seen;
+  size_t num_kept = 0;
+  for (size_t i = 0; i < candidates->size() && num_kept < width; ++i) {
+    const Candidate& candidate = (*candidates)[i];
+    auto inserted = seen.insert(
+        std::make_pair(candidate.child->state_hash, num_kept));
+    if (!inserted.second) {
+      Game kept_game;
+      Game game;
+      RestoreCandidate(states, (*candidates)[inserted.first->second],
+                       &kept_game);
+      RestoreCandidate(states, candidate, &game);
+      if (game.HasSameState(kept_game)) {
+        continue;
+      }
+    }
+    (*candidates)[num_kept++] = candidate;
+  }
+  candidates->resize(num_kept);
+}
+
+// Places the current unit at each reachable location on a scratch game, and
+// scores the result.
+static void ExpandGame(GameScorer* scorer, const Game& game,
+                       SearchCache::Children* children) {
+  std::vector<Game::SearchResult> bfsresult;
+  game.ReachableUnits(&bfsresult);
+  children->reserve(bfsresult.size());
+  Game scratch;
+  for (const auto& result : bfsresult) {
+    scratch = game;
+    bool f2 = !scratch.PlaceUnit(result.first);
+    // TODO: debug
+    int64_t score = scorer->Score(scratch, f2, nullptr);
+    children->push_back(SearchCache::Child {
+        result.first, f2, score, scratch.score(), scratch.StateHash()});
+  }
 }
 
-DuralStarmanSolver::DuralStarmanSolver(GameScorer* scorer, int width, int depth)
-  : scorer_(scorer), width_(width), depth_(depth) {}
+SearchCache::SearchCache(size_t max_entries)
+  : max_entries_per_shard_(std::max<size_t>(1, max_entries / kNumShards)) {}
+SearchCache::~SearchCache() {}
+
+std::shared_ptr<const SearchCache::Children> SearchCache::Find(
+    const Game& game) {
+  const size_t key = Key(game.StateHash(), game.score());
+  Shard& shard = shards_[key % kNumShards];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end() || it->second.game_score != game.score() ||
+      !game.HasState(it->second.state)) {
+    return nullptr;
+  }
+  return it->second.children;
+}
+
+void SearchCache::Insert(const Game& game,
+                         const std::shared_ptr<const Children>& children) {
+  const size_t key = Key(game.StateHash(), game.score());
+  Shard& shard = shards_[key % kNumShards];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.entries.size() >= max_entries_per_shard_) {
+    shard.entries.clear();
+  }
+  shard.entries[key] = Entry {game.GetStateKey(), game.score(), children};
+}
+
+DuralStarmanSolver::DuralStarmanSolver(GameScorer* scorer, int width, int depth,
+                                       int max_width, ThreadPool* pool)
+  : scorer_(scorer), width_(width, max_width), depth_(depth),
+    anytime_max_depth_(0), cache_(nullptr), num_root_children_(0),
+    own_pool_(pool ? nullptr : new ThreadPool(FLAGS_threads)),
+    pool_(pool ? pool : own_pool_.get()) {}
 DuralStarmanSolver::~DuralStarmanSolver() {}
 
 std::string DuralStarmanSolver::NextCommands(const Game& game) {
+  std::string result_command;
+  if (anytime_max_depth_ > 0) {
+    result_command = SearchAnytime(game);
+  } else {
+    result_command = Search(game, width_.width(), depth_, nullptr);
+  }
+
+  // States of two generations, the children of a generation, and candidates
+  // for a chunk of states. The root tells how many children a state has.
+  width_.Update(2 * (sizeof(GameState) + BeamState::ApproxMemoryUsage(game) +
+                     result_command.size()) +
+                num_root_children_ * (sizeof(SearchCache::Child) +
+                                      kExpandChunkSize * sizeof(Candidate)));
+  return result_command;
+}
+
+std::string DuralStarmanSolver::SearchAnytime(const Game& game) {
+  const auto start = std::chrono::steady_clock::now();
+  const double budget =
+      GetRemainingSeconds() / std::max(1, game.units_remaining());
+  const int base_width = width_.width();
+  const int max_width = width_.fitting_width() > 0 ?
+      std::max(base_width, width_.fitting_width()) :
+      base_width * kMaxAnytimeWidthFactor;
+  int width = base_width;
+  int depth = depth_;
+  std::string result_command;
+  while (true) {
+    const auto iteration_start = std::chrono::steady_clock::now();
+    bool exhausted = false;
+    result_command = Search(game, width, depth, &exhausted);
+    const auto end = std::chrono::steady_clock::now();
+    const double cost =
+        std::chrono::duration<double>(end - iteration_start).count();
+    const double elapsed = std::chrono::duration<double>(end - start).count();
+
+    // The cost grows about linearly both in depth and in width.
+    const bool deepen = depth < anytime_max_depth_ && !exhausted;
+    const double next_cost = deepen ?
+        cost * (depth + 2) / (depth + 1) : cost * 2;
+    if (elapsed + next_cost > budget ||
+        (!deepen && width >= max_width)) {
+      VLOG(1) << "anytime: depth " << depth << ", width " << width
+              << ", " << elapsed << "/" << budget << "s";
+      break;
+    }
+    if (deepen) {
+      ++depth;
+    } else {
+      width = std::min(width * 2, max_width);
+    }
+  }
+  return result_command;
+}
+
+std::string DuralStarmanSolver::Search(const Game& game, int width, int depth,
+                                       bool* exhausted) {
   std::vector<std::unique_ptr<GameState>> prev_states;
-  prev_states.emplace_back(new GameState(game, false, 0));
+  prev_states.emplace_back(
+      new GameState(std::make_shared<const BeamState>(game), false, 0));
+  // Children are in the same order as these, as long as the BFS is stable.
+  std::vector<Game::SearchResult> root_results;
+  game.ReachableUnits(&root_results);
+  num_root_children_ = root_results.size();
   std::string result_command;
-  for (int d = 0; d <= depth_; ++d) {
-    std::vector<std::unique_ptr<GameState>> next_states;
-    for (const auto& p : prev_states) {
-      if (p->finished) {
-        continue;
+  for (int d = 0; d <= depth; ++d) {
+    // Score the children of each state on a scratch game, possibly in
+    // parallel, and keep only the top width of them per state. States are
+    // created later only for the ones surviving the selection.
+    std::vector<Candidate> candidates;
+    // Keeps the children referred from the candidates alive.
+    std::vector<std::shared_ptr<const SearchCache::Children>> children(
+        prev_states.size());
+    size_t num_candidates = 0;
+    for (size_t begin = 0; begin < prev_states.size();
+         begin += kExpandChunkSize) {
+      const size_t end = std::min(prev_states.size(),
+                                  begin + kExpandChunkSize);
+      std::vector<std::vector<Candidate>> buffers(end - begin);
+      pool_->ParallelFor(end - begin, [&](int k) {
+          const int i = begin + k;
+          const auto& p = prev_states[i];
+          if (p->finished) {
+            return;
+          }
+          Game cur_game;
+          p->state->Restore(&cur_game);
+          if (cache_) {
+            children[i] = cache_->Find(cur_game);
+          }
+          if (!children[i]) {
+            std::shared_ptr<SearchCache::Children> expanded(
+                new SearchCache::Children);
+            ExpandGame(scorer_, cur_game, expanded.get());
+            if (cache_) {
+              cache_->Insert(cur_game, expanded);
+            }
+            children[i] = expanded;
+          }
+          // Children reaching the same state take only one slot, so that
+          // they do not push out the others before the selection.
+          std::vector<Candidate>& buffer = buffers[k];
+          buffer.reserve(children[i]->size());
+          std::unordered_map<size_t, int> seen;
+          for (int j = 0; j < children[i]->size(); ++j) {
+            const SearchCache::Child& child = (*children[i])[j];
+            auto inserted = seen.insert(std::make_pair(child.state_hash, j));
+            if (!inserted.second &&
+                HaveSameChildState(
+                    cur_game, (*children[i])[inserted.first->second].location,
+                    child.location)) {
+              continue;
+            }
+            buffer.push_back(Candidate {i, j, &child});
+          }
+          if (buffer.size() > width) {
+            std::nth_element(buffer.begin(), buffer.begin() + width,
+                             buffer.end(), by_score_descend);
+            buffer.resize(width);
+          }
+        });
+      for (const auto& buffer : buffers) {
+        candidates.insert(candidates.end(), buffer.begin(), buffer.end());
+        num_candidates += buffer.size();
       }
-      Game cur_game(p->game);
-
-      std::vector<Game::SearchResult> bfsresult;
-      cur_game.ReachableUnits(&bfsresult);
-      for (const auto& res : bfsresult) {
-        Game ng(cur_game);
-        bool f2 = !ng.RunSequence(res.second);
-        std::string nd;
-        int64_t score;
-        score = scorer_->Score(ng, f2, nullptr);  // TODO: debug
-        std::unique_ptr<GameState> ngs(new GameState(ng, f2, score));
+      SelectCandidates(prev_states, &candidates, width);
+    }
+    if (d == 0) {
+      // Commands of the root children are looked up by index.
+      CHECK_EQ(root_results.size(), children[0]->size());
+    }
+    VLOG(1) << "d:" << d << ", width " << prev_states.size() << "->"
+            << num_candidates << ">>" << width;
+
+    std::vector<std::unique_ptr<GameState>> next_states(candidates.size());
+    pool_->ParallelFor(candidates.size(), [&](int i) {
+        const Candidate& c = candidates[i];
+        const SearchCache::Child& child = *c.child;
+        const GameState& p = *prev_states[c.parent];
+        std::unique_ptr<GameState> ngs(new GameState(
+            std::make_shared<const BeamState>(p.state, child.location),
+            child.finished, child.score));
         if (d == 0) {
-          ngs->command0 = Game::Commands2SimpleString(res.second);
+          ngs->command0 =
+              Game::Commands2SimpleString(root_results[c.index].second);
         } else {
-          ngs->command0 = p->command0;
+          ngs->command0 = p.command0;
         }
-        next_states.emplace_back(std::move(ngs));
-      }
-    }
-    sort(next_states.begin(), next_states.end(), by_score_descend);
-    VLOG(1) << "d:" << d << ", width " << prev_states.size() << "->"
-            << next_states.size() << ">>" << width_;
-    if (next_states.size() > width_) {
-      next_states.resize(width_);
-    }
+        next_states[i] = std::move(ngs);
+      });
     prev_states.swap(next_states);
     if (!prev_states.empty()) {
       result_command = prev_states[0]->command0;
     } else {
-      return result_command;
+      if (exhausted) {
+        *exhausted = true;
+      }
+      break;
     }
   }
   return result_command;
 }
+
+DuralStarmanPortfolio::DuralStarmanPortfolio(
+    GameScorer* scorer, const std::vector<std::pair<int, int>>& configs,
+    size_t cache_entries)
+  : cache_(cache_entries),
+    // Each lane thread also takes part in its loops.
+    pool_(new ThreadPool(std::max<int>(
+        1, FLAGS_threads - static_cast<int>(configs.size()) + 1))),
+    stop_(false), updated_(false) {
+  for (const auto& config : configs) {
+    std::unique_ptr<Lane> lane(new Lane);
+    lane->solver.reset(
+        new DuralStarmanSolver(scorer, config.first, config.second, 0,
+                               pool_.get()));
+    lane->solver->SetCache(&cache_);
+    lane->score = 0;
+    lane->finished = false;
+    lanes_.push_back(std::move(lane));
+  }
+}
+
+DuralStarmanPortfolio::~DuralStarmanPortfolio() {
+  Finish();
+}
+
+void DuralStarmanPortfolio::Finish() {
+  stop_ = true;
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+}
+
+void DuralStarmanPortfolio::AddGame(const Game& game) {
+  Finish();
+  stop_ = false;
+  for (auto& lane : lanes_) {
+    lane->commands.clear();
+    lane->score = 0;
+    lane->finished = false;
+  }
+  for (auto& lane : lanes_) {
+    threads_.emplace_back(&DuralStarmanPortfolio::RunLane, this, lane.get(),
+                          game);
+  }
+}
+
+void DuralStarmanPortfolio::RunLane(Lane* lane, const Game& game) {
+  std::unique_ptr<Solver2> runner(ConvertS12(lane->solver.get()));
+  runner->AddGame(game);
+  std::string commands;
+  int score = 0;
+  bool finished = false;
+  while (!finished && !stop_) {
+    finished = runner->Next(&commands, &score);
+    std::lock_guard<std::mutex> lock(mutex_);
+    lane->commands = commands;
+    lane->score = score;
+    lane->finished = finished;
+    updated_ = true;
+    cv_.notify_all();
+  }
+}
+
+bool DuralStarmanPortfolio::Next(std::string* best_command, int* score) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait_for(lock, std::chrono::milliseconds(100),
+               [this] { return updated_; });
+  updated_ = false;
+
+  // Ties go to the configuration listed first.
+  const Lane* best = nullptr;
+  bool all_finished = true;
+  for (const auto& lane : lanes_) {
+    if (!best || lane->score > best->score) {
+      best = lane.get();
+    }
+    all_finished &= lane->finished;
+  }
+  if (best_command) {
+    *best_command = best->commands;
+  }
+  if (score) {
+    *score = best->score;
+  }
+  return all_finished;
+}
@@ -1,23 +1,141 @@
 #ifndef DURALSTARMAN_H__
 #define DURALSTARMAN_H__
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "../../simulator/game.h"
+#include "../../simulator/memory_budget.h"
 #include "../../simulator/solver.h"
+#include "../../simulator/thread_pool.h"
 #include "../kamineko/kamineko.h"
 
+// Children of games in a search, keyed by the state of Game::StateHash() and
+// the score so far. Entries keep the state itself, so that a hash collision
+// is a miss. Shared by the moves of a solver and by the solvers of a
+// portfolio, which must use the same scorer. Thread safe.
+class SearchCache {
+ public:
+  // A reachable placement of the current unit, and the game after it.
+  struct Child {
+    UnitLocation location;
+    bool finished;
+    int64_t score;  // By the scorer.
+    int game_score;
+    size_t state_hash;
+  };
+  // In the order of Game::ReachableUnits().
+  typedef std::vector<Child> Children;
+
+  // The table is cleared when it grows over |max_entries|.
+  explicit SearchCache(size_t max_entries);
+  ~SearchCache();
+
+  // Returns null if not found.
+  std::shared_ptr<const Children> Find(const Game& game);
+  void Insert(const Game& game,
+              const std::shared_ptr<const Children>& children);
+
+ private:
+  static const int kNumShards = 16;
+  struct Entry {
+    Game::StateKey state;
+    int game_score;
+    std::shared_ptr<const Children> children;
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<size_t, Entry> entries;
+  };
+
+  static size_t Key(size_t state_hash, int game_score) {
+    return state_hash * 1000003 + game_score;
+  }
+
+  size_t max_entries_per_shard_;
+  Shard shards_[kNumShards];
+
+  DISALLOW_COPY_AND_ASSIGN(SearchCache);
+};
+
 class DuralStarmanSolver : public Solver {
  public:
-  DuralStarmanSolver(GameScorer* scorer, int width, int depth);
+  // If |max_width| is positive, the width adapts to the memory limit up to
+  // it. Runs on |pool| if given, otherwise on a pool of --threads of its own.
+  DuralStarmanSolver(GameScorer* scorer, int width, int depth,
+                     int max_width, ThreadPool* pool);
   virtual ~DuralStarmanSolver();
   virtual std::string NextCommands(const Game& game);
+
+  // Makes the search anytime. The time left until --deadline is divided
+  // evenly among the remaining units, and for each move the search is
+  // repeated deeper, up to |max_depth|, then wider, while the time remains.
+  void SetAnytime(int max_depth) { anytime_max_depth_ = max_depth; }
+
+  // Makes the search use |cache|, which must be used with the same scorer.
+  void SetCache(SearchCache* cache) { cache_ = cache; }
+
  private:
+  // Runs the beam search and returns the commands for the current unit.
+  // |exhausted| is set if every state finished before reaching |depth|.
+  std::string Search(const Game& game, int width, int depth, bool* exhausted);
+  std::string SearchAnytime(const Game& game);
+
   GameScorer* scorer_;
-  int width_;
+  BeamWidthController width_;
   int depth_;
+  int anytime_max_depth_;
+  SearchCache* cache_;
+  size_t num_root_children_;
+  std::unique_ptr<ThreadPool> own_pool_;
+  ThreadPool* pool_;
+};
+
+// Runs DuralStarman with several (width, depth) configurations at once, each
+// on its own thread, sharing the problem, a SearchCache and a thread pool.
+// The lanes and the pool together use --threads threads, or one per lane if
+// there are more lanes. Reports the best scored solution among them.
+class DuralStarmanPortfolio : public Solver2 {
+ public:
+  DuralStarmanPortfolio(GameScorer* scorer,
+                        const std::vector<std::pair<int, int>>& configs,
+                        size_t cache_entries);
+  virtual ~DuralStarmanPortfolio();
+
+  virtual void AddGame(const Game& game);
+  // Waits for a while for some configuration to make progress.
+  virtual bool Next(std::string* best_command, int* score);
+  virtual void Finish();
+
+ private:
+  struct Lane {
+    std::unique_ptr<DuralStarmanSolver> solver;
+    std::string commands;
+    int score;
+    bool finished;
+  };
+
+  void RunLane(Lane* lane, const Game& game);
+
+  SearchCache cache_;
+  // Declared before lanes_, whose solvers use it.
+  std::unique_ptr<ThreadPool> pool_;
+  std::vector<std::unique_ptr<Lane>> lanes_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> stop_;
+  // Guards the results in lanes_ and updated_.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool updated_;
+
+  DISALLOW_COPY_AND_ASSIGN(DuralStarmanPortfolio);
 };
 
 #endif  // DURALSTARMAN_H__
@@ -1,3 +1,8 @@
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
@@ -6,20 +11,90 @@
 
 DEFINE_int32(dural_width, 20, "");
 DEFINE_int32(dural_depth, 2, "");
+DEFINE_int32(dural_max_depth, 19,
+             "Max depth of the anytime search, used with --deadline.");
+DEFINE_int32(dural_max_width, 0,
+             "The width adapts to the memory limit up to this. If 0, it "
+             "only shrinks from --dural_width.");
+DEFINE_string(dural_portfolio, "",
+              "Comma-separated width:depth pairs, e.g. 32:3,32:5. If given, "
+              "runs them at once in this process and outputs the best.");
+DEFINE_int32(dural_cache_entries, 2048,
+             "Max boards in the cache shared by a portfolio.");
+
+static std::vector<std::pair<int, int>> ParsePortfolio(
+    const std::string& spec) {
+  std::vector<std::pair<int, int>> configs;
+  std::istringstream is(spec);
+  std::string item;
+  while (std::getline(is, item, ',')) {
+    std::pair<int, int> config;
+    char colon;
+    std::istringstream item_is(item);
+    CHECK(item_is >> config.first >> colon >> config.second && colon == ':')
+        << "Bad --dural_portfolio item: " << item;
+    configs.push_back(config);
+  }
+  CHECK(!configs.empty()) << "Empty --dural_portfolio";
+  return configs;
+}
+
+static KaminekoScorer* GetBaseScorer() {
+  static KaminekoScorer base_scorer;
+  return &base_scorer;
+}
+
+static Solver* NewDuralStarman() {
+  DuralStarmanSolver* solver = new DuralStarmanSolver(
+      GetBaseScorer(), FLAGS_dural_width, FLAGS_dural_depth,
+      FLAGS_dural_max_width, nullptr);
+#ifndef FIXED_WIDTH
+  if (FLAGS_deadline > 0) {
+    solver->SetAnytime(FLAGS_dural_max_depth);
+  }
+#endif
+  return solver;
+}
+
+static Solver2* NewDuralStarmanPortfolio() {
+  return new DuralStarmanPortfolio(GetBaseScorer(),
+                                   ParsePortfolio(FLAGS_dural_portfolio),
+                                   FLAGS_dural_cache_entries);
+}
+
+REGISTER_SOLVER(duralstarman, "DuralStarman", NewDuralStarman);
+REGISTER_SOLVER2(duralstarman_portfolio, "DuralStarman",
+                 NewDuralStarmanPortfolio);
+
+#ifdef SOLVER_HOST
+// Same as the ds_N binaries.
+static Solver* NewFixedDuralStarman(int depth) {
+  return new DuralStarmanSolver(GetBaseScorer(), 32, depth,
+                                FLAGS_dural_max_width, nullptr);
+}
 
+REGISTER_SOLVER(ds_3, "DuralStarman", [] { return NewFixedDuralStarman(3); });
+REGISTER_SOLVER(ds_5, "DuralStarman", [] { return NewFixedDuralStarman(5); });
+REGISTER_SOLVER(ds_7, "DuralStarman", [] { return NewFixedDuralStarman(7); });
+REGISTER_SOLVER(ds_13, "DuralStarman",
+                [] { return NewFixedDuralStarman(13); });
+REGISTER_SOLVER(ds_19, "DuralStarman",
+                [] { return NewFixedDuralStarman(19); });
+#else
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  KaminekoScorer base_scorer;
 
 #ifdef FIXED_WIDTH
   FLAGS_dural_depth = FIXED_WIDTH;
   FLAGS_dural_width = 32;
 #endif
 
-  return RunSolver(
-      new DuralStarmanSolver(&base_scorer, FLAGS_dural_width, FLAGS_dural_depth),
-      "DuralStarman");
+  if (!FLAGS_dural_portfolio.empty()) {
+    return RunSolver2(NewDuralStarmanPortfolio, "DuralStarman");
+  }
+  return RunSolver(NewDuralStarman, "DuralStarman");
 }
+#endif  // SOLVER_HOST
@@ -0,0 +1,184 @@
+// Runs many solvers on many problems in one process. Each job solves a seed
+// of a problem with a solver, and writes the same result lines as the
+// solver binary would.
+//
+//   host --solvers=greedy_ai_3,trivial_solver,kamineko:10 \
+//        --problems=problems/problem_0.json,problems/problem_1.json
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <picojson.h>
+
+#include "../../simulator/game.h"
+#include "../../simulator/solver.h"
+#include "../../simulator/thread_pool.h"
+
+DEFINE_string(solvers, "",
+              "Comma-separated solver names, each optionally followed by "
+              "\":seconds\" to limit each of its games.");
+DEFINE_string(problems, "", "Comma-separated paths of problem JSON files.");
+DEFINE_int32(host_threads, 0,
+             "Games solved at the same time. 0 means the number of cores.");
+DEFINE_bool(list_solvers, false, "Print the registered solvers and exit.");
+
+// Defined in ai/duralstarman/main.cc.
+DECLARE_string(dural_portfolio);
+
+namespace {
+
+struct SolverSpec {
+  std::string name;
+  const RegisteredSolver* solver;
+  // Seconds for each game, or 0 for no limit other than --deadline.
+  double seconds;
+};
+
+struct Job {
+  const SolverSpec* spec;
+  const GameData* game_data;
+  int seed_index;
+};
+
+std::vector<std::string> SplitByComma(const std::string& text) {
+  std::vector<std::string> items;
+  std::istringstream is(text);
+  std::string item;
+  while (std::getline(is, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+std::vector<SolverSpec> ParseSolvers(const std::string& text) {
+  std::vector<SolverSpec> specs;
+  for (const std::string& item : SplitByComma(text)) {
+    SolverSpec spec;
+    std::string::size_type colon = item.find(':');
+    spec.name = item.substr(0, colon);
+    spec.seconds =
+        colon == std::string::npos ? 0 : std::stod(item.substr(colon + 1));
+    spec.solver = FindRegisteredSolver(spec.name);
+    CHECK(spec.solver) << "Unknown solver: " << spec.name;
+    // Checked here rather than when a job creates the solver, which would
+    // abort the jobs running meanwhile.
+    CHECK(spec.name != "duralstarman_portfolio" ||
+          !FLAGS_dural_portfolio.empty())
+        << "duralstarman_portfolio needs --dural_portfolio";
+    specs.push_back(spec);
+  }
+  CHECK(!specs.empty()) << "No --solvers";
+  return specs;
+}
+
+void LoadGameData(const std::string& path, GameData* data) {
+  std::ifstream in(path);
+  picojson::value problem;
+  in >> problem;
+  CHECK(in.good()) << path << ": " << picojson::get_last_error();
+  data->Load(problem);
+}
+
+// Ends the game when the time of the job is over, for solvers which do not
+// look at GetRemainingSeconds() themselves.
+class DeadlineSolver : public Solver2 {
+ public:
+  explicit DeadlineSolver(Solver2* solver) : solver_(solver) {}
+
+  virtual void AddGame(const Game& game) {
+    solver_->AddGame(game);
+  }
+
+  virtual bool Next(std::string* best_command, int* score) {
+    return solver_->Next(best_command, score) || GetRemainingSeconds() <= 0;
+  }
+
+  virtual void Finish() {
+    solver_->Finish();
+  }
+
+ private:
+  Solver2* solver_;
+
+  DISALLOW_COPY_AND_ASSIGN(DeadlineSolver);
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  FLAGS_logtostderr = true;
+  if (FLAGS_list_solvers) {
+    for (const std::string& name : GetRegisteredSolverNames()) {
+      std::cout << name << std::endl;
+    }
+    return 0;
+  }
+
+  const std::vector<SolverSpec> specs = ParseSolvers(FLAGS_solvers);
+  const std::vector<std::string> paths = SplitByComma(FLAGS_problems);
+  // Each problem is loaded once, and its games share the data.
+  std::vector<std::unique_ptr<GameData>> game_data;
+  for (const std::string& path : paths) {
+    game_data.emplace_back(new GameData());
+    LoadGameData(path, game_data.back().get());
+  }
+
+  // Like the supervisor, solvers in the order given, and small boards first
+  // for each of them.
+  std::vector<const GameData*> problems;
+  for (const auto& data : game_data) {
+    problems.push_back(data.get());
+  }
+  std::stable_sort(problems.begin(), problems.end(),
+                   [](const GameData* a, const GameData* b) {
+                     return a->board().width() * a->board().height() <
+                         b->board().width() * b->board().height();
+                   });
+  std::vector<Job> jobs;
+  for (const SolverSpec& spec : specs) {
+    for (const GameData* data : problems) {
+      for (size_t i = 0; i < data->source_seeds().size(); ++i) {
+        jobs.push_back(Job{&spec, data, static_cast<int>(i)});
+      }
+    }
+  }
+
+  int num_threads = FLAGS_host_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min<int>(num_threads, jobs.size());
+  SetNumConcurrentGames(num_threads);
+  SetSolverSignalHandlers();
+
+  ThreadPool pool(num_threads);
+  pool.ParallelFor(jobs.size(), [&jobs](int i) {
+    if (IsInterruptedBySignal()) {
+      return;
+    }
+    const Job& job = jobs[i];
+    double seconds = GetRemainingSeconds();
+    if (job.spec->seconds > 0) {
+      seconds = std::min(seconds, job.spec->seconds);
+    }
+    ScopedGameDeadline deadline(seconds);
+    std::unique_ptr<Solver2> solver(job.spec->solver->factory());
+    DeadlineSolver deadline_solver(solver.get());
+    SolveGame(&deadline_solver, *job.game_data, job.seed_index,
+              job.spec->solver->tag, nullptr);
+  });
+  return 0;
+}
@@ -4,6 +4,8 @@
 #include <limits>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <gflags/gflags.h>
@@ -19,6 +21,13 @@
 #define ENABLE_DEBUG_LOG 0
 
 DEFINE_int32(kamineko_hands, 8, "");
+DEFINE_int32(kamineko_max_hands, 0,
+             "The number of hands adapts to the memory limit up to this. "
+             "If 0, it only shrinks from --kamineko_hands.");
+
+// The number of paths expanded at once. Candidates are held only for a chunk
+// at a time, which bounds the memory for them.
+static const int kExpandChunkSize = 16;
 
 template<typename T>
 std::string DumpV(const std::vector<T>& seq) {
@@ -70,12 +79,14 @@ int64_t KaminekoScorer::Score(const Game& game, bool finished,
 }
 
 Kamineko::Kamineko()
-  : scorer_(new KaminekoScorer()) {
+  : scorer_(new KaminekoScorer()), pool_(FLAGS_threads),
+    width_(FLAGS_kamineko_hands, FLAGS_kamineko_max_hands), state_bytes_(0) {
   path_.reserve(FLAGS_kamineko_hands + 1);
 }
 
 Kamineko::Kamineko(GameScorer* scorer)
-  : scorer_(scorer) {
+  : scorer_(scorer), pool_(FLAGS_threads),
+    width_(FLAGS_kamineko_hands, FLAGS_kamineko_max_hands), state_bytes_(0) {
   path_.reserve(FLAGS_kamineko_hands + 1);
 }
 
@@ -89,6 +100,19 @@ static int64_t MinScore(const Game& game) {
     2 * (height * width * height * 100 + height * width * 2000);
 }
 
+static bool ByScoreGreater(const std::unique_ptr<Kamineko::GamePath>& lhs,
+                           const std::unique_ptr<Kamineko::GamePath>& rhs) {
+  return lhs->score > rhs->score;
+}
+
+// Returns whether a path with the score would survive in the beam.
+// |path| is kept as a min-heap on score, so its front is the worst one.
+static bool IsWorthAdding(
+    const std::vector<std::unique_ptr<Kamineko::GamePath> >& path,
+    int64_t score, int width) {
+  return path.size() < width || path.front()->score < score;
+}
+
 std::unique_ptr<Kamineko::GamePath> AddNewPath(
     std::vector<std::unique_ptr<Kamineko::GamePath> >* pathp,
     std::unique_ptr<Kamineko::GamePath> next,
@@ -96,26 +120,76 @@ std::unique_ptr<Kamineko::GamePath> AddNewPath(
   std::vector<std::unique_ptr<Kamineko::GamePath> >& path = *pathp;
   if (path.size() < width) {
     path.emplace_back(std::move(next));
+    std::push_heap(path.begin(), path.end(), ByScoreGreater);
     return nullptr;
   }
-  int min_index = 0;
-  int min_score = path[0]->score;
-  for (int i = 1; i < path.size(); ++i) {
-    if (min_score > path[i]->score) {
-      min_index = i;
-      min_score = path[i]->score;
+  if (path.front()->score < next->score) {
+    std::pop_heap(path.begin(), path.end(), ByScoreGreater);
+    std::swap(path.back(), next);
+    std::push_heap(path.begin(), path.end(), ByScoreGreater);
+  }
+  return next;
+}
+
+// Returns whether placing the current unit of |game| at |location| gives the
+// same state as |child|.
+static bool HaveSameChildState(const Game& game, const UnitLocation& location,
+                               const Game& child) {
+  Game placed(game);
+  placed.PlaceUnit(location);
+  return placed.HasSameState(child);
+}
+
+// Returns whether the paths reach the same state. Paths are compared by
+// their hashes first, so this runs only on a hash match.
+static bool HaveSameState(const Kamineko::GamePath& lhs,
+                          const Kamineko::GamePath& rhs) {
+  Game lhs_game;
+  Game rhs_game;
+  lhs.state->Restore(&lhs_game);
+  rhs.state->Restore(&rhs_game);
+  return lhs_game.HasSameState(rhs_game);
+}
+
+// Same as AddNewPath, but merges paths reaching the same state, keeping the
+// best scored one, so that they do not occupy several slots of the beam.
+// |index| maps state hashes to the paths in |path|. On a hash collision,
+// the path is added without being indexed.
+void MergeNewPath(
+    std::vector<std::unique_ptr<Kamineko::GamePath> >* pathp,
+    std::unordered_map<size_t, Kamineko::GamePath*>* indexp,
+    std::unique_ptr<Kamineko::GamePath> next,
+    int width) {
+  std::vector<std::unique_ptr<Kamineko::GamePath> >& path = *pathp;
+  std::unordered_map<size_t, Kamineko::GamePath*>& index = *indexp;
+  auto found = index.find(next->state_hash);
+  if (found != index.end() && HaveSameState(*found->second, *next)) {
+    if (found->second->score < next->score) {
+      *found->second = std::move(*next);
+      std::make_heap(path.begin(), path.end(), ByScoreGreater);
     }
+    return;
   }
-  if (min_score < next->score) {
-    std::swap(path[min_index], next);
+  if (!IsWorthAdding(path, next->score, width)) {
+    return;
   }
-  return next;
+  Kamineko::GamePath* added = next.get();
+  std::unique_ptr<Kamineko::GamePath> evicted =
+      AddNewPath(pathp, std::move(next), width);
+  if (evicted) {
+    auto evicted_found = index.find(evicted->state_hash);
+    if (evicted_found != index.end() &&
+        evicted_found->second == evicted.get()) {
+      index.erase(evicted_found);
+    }
+  }
+  index.insert(std::make_pair(added->state_hash, added));
 }
 
 const Kamineko::GamePath& GetBest(
     const std::vector<std::unique_ptr<Kamineko::GamePath> >& path) {
   int max_index = 0;
-  int max_score = path[0]->score;
+  int64_t max_score = path[0]->score;
   for (int i = 1; i < path.size(); ++i) {
     if (max_score < path[i]->score) {
       max_index = i;
@@ -125,49 +199,138 @@ const Kamineko::GamePath& GetBest(
   return *path[max_index];
 }
 
+void Kamineko::MaterializeCommands(
+    const std::shared_ptr<const CommandChain>& chain) {
+  // Find the common ancestor of the new chain and the previous one, while
+  // collecting the nodes to be appended.
+  std::vector<const CommandChain*> suffix;
+  const CommandChain* node = chain.get();
+  const CommandChain* prev = best_chain_.get();
+  while (node && (!prev || node->depth > prev->depth)) {
+    suffix.push_back(node);
+    node = node->parent.get();
+  }
+  while (prev && (!node || prev->depth > node->depth)) {
+    prev = prev->parent.get();
+  }
+  while (node != prev) {
+    suffix.push_back(node);
+    node = node->parent.get();
+    prev = prev->parent.get();
+  }
+
+  best_commands_.resize(node ? node->length : 0);
+  best_commands_.reserve(chain ? chain->length : 0);
+  for (auto iter = suffix.rbegin(); iter != suffix.rend(); ++iter) {
+    best_commands_ += (*iter)->commands;
+  }
+  best_chain_ = chain;
+}
+
 void Kamineko::AddGame(const Game& game) {
   path_.clear();
-  path_.emplace_back(new GamePath(game, false, 0, "", ""));
+  path_.emplace_back(new GamePath(std::make_shared<const BeamState>(game),
+                                  game, false, 0, nullptr, ""));
+  best_chain_.reset();
+  best_commands_.clear();
+  state_bytes_ = BeamState::ApproxMemoryUsage(game);
 }
 
-bool Kamineko::Next(std::string* best_command, int* res_score) {
-  std::vector<std::unique_ptr<Kamineko::GamePath> > next_path;
-  for (const auto& p0 : path_) {
-    if (p0->finished) {
-      continue;
-    }
-    const Game& cur_game = p0->game;
-
-    std::vector<Game::SearchResult> bfsresult;
-    cur_game.ReachableUnits(&bfsresult);
-    for (const auto &res : bfsresult) {
-      Game ng(cur_game);
-      std::string debug;
-      bool finished = !ng.RunSequence(res.second);
+int64_t Kamineko::GetBytesPerWidth() const {
+  // A path in the beam, and candidates for a chunk of paths.
+  int64_t commands_bytes = sizeof(CommandChain) + sizeof(void*) * 2;
+  if (best_chain_) {
+    commands_bytes += best_chain_->length / (best_chain_->depth + 1);
+  }
+  int64_t path_bytes = sizeof(GamePath) + commands_bytes + state_bytes_;
+  return path_bytes * (1 + kExpandChunkSize);
+}
+
+void Kamineko::Expand(const GamePath& path, int width, int64_t threshold,
+                      std::vector<std::unique_ptr<GamePath> >* candidates) {
+  Game cur_game;
+  path.state->Restore(&cur_game);
+
+  std::vector<Game::SearchResult> bfsresult;
+  cur_game.ReachableUnits(&bfsresult);
+  // Children are scored on a scratch game. Only the lock location is kept
+  // when they enter the beam.
+  Game ng;
+  // Locations of the children by state hash. Placements reaching the same
+  // state take only one slot, so that they do not push out the others.
+  std::unordered_map<size_t, UnitLocation> seen;
+  for (const auto &res : bfsresult) {
+    ng = cur_game;
+    std::string debug;
+    bool finished = !ng.PlaceUnit(res.first);
 #if ENABLE_DEBUG_LOG
-      const int64_t score = scorer_->Score(ng, finished, &debug);
+    const int64_t score = scorer_->Score(ng, finished, &debug);
 #else
-      const int64_t score = scorer_->Score(ng, finished, nullptr);
+    const int64_t score = scorer_->Score(ng, finished, nullptr);
 #endif
-      AddNewPath(
-          &next_path,
-          std::unique_ptr<Kamineko::GamePath>(new Kamineko::GamePath(
-              ng, finished, score,
-              p0->commands + Game::Commands2SimpleString(res.second),
-              debug)),
-          FLAGS_kamineko_hands);
+    if (score <= threshold || !IsWorthAdding(*candidates, score, width)) {
+      continue;
+    }
+    auto inserted = seen.insert(std::make_pair(ng.StateHash(), res.first));
+    if (!inserted.second &&
+        HaveSameChildState(cur_game, inserted.first->second, ng)) {
+      continue;
+    }
+    std::shared_ptr<const CommandChain> commands(
+        new CommandChain(path.commands,
+                         Game::Commands2SimpleString(res.second)));
+    AddNewPath(
+        candidates,
+        std::unique_ptr<GamePath>(new GamePath(
+            std::make_shared<const BeamState>(path.state, res.first, ng),
+            ng, finished, score, commands, debug)),
+        width);
+  }
+}
+
+bool Kamineko::Next(std::string* best_command, int* res_score) {
+  const int width = width_.width();
+  std::vector<std::unique_ptr<Kamineko::GamePath> > next_path;
+  next_path.reserve(width);
+  std::unordered_map<size_t, GamePath*> state_index;
+
+  // Each path is expanded into its own buffer, possibly in parallel, and the
+  // buffers are merged in the path order. So the result does not depend on
+  // the number of threads.
+  for (size_t begin = 0; begin < path_.size(); begin += kExpandChunkSize) {
+    const size_t end = std::min(path_.size(), begin + kExpandChunkSize);
+    // The worst score in the beam never decreases, so candidates not better
+    // than it can be dropped early.
+    const int64_t threshold = next_path.size() < width ?
+        std::numeric_limits<int64_t>::min() : next_path.front()->score;
+    std::vector<std::vector<std::unique_ptr<GamePath> > > candidates(
+        end - begin);
+    pool_.ParallelFor(end - begin, [&](int i) {
+        const GamePath& path = *path_[begin + i];
+        if (!path.finished) {
+          Expand(path, width, threshold, &candidates[i]);
+        }
+      });
+    for (auto& buffer : candidates) {
+      for (auto& candidate : buffer) {
+        MergeNewPath(&next_path, &state_index, std::move(candidate), width);
+      }
     }
   }
   path_.swap(next_path);
   if (VLOG_IS_ON(1)) {
     for (const auto& p : path_) {
+      Game game;
+      p->state->Restore(&game);
       VLOG(1) << "G#" << p->score
-              << " \ngame:\n" << p->game
+              << " \ngame:\n" << game
               << "\ndebug:" << p->debug;
     }
   }
   const Kamineko::GamePath& p = GetBest(path_);
-  *res_score = p.game.score();
-  *best_command = p.commands;
+  MaterializeCommands(p.commands);
+  *res_score = p.game_score;
+  *best_command = best_commands_;
+  width_.Update(GetBytesPerWidth());
   return p.finished;
 }
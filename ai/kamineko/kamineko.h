@@ -5,8 +5,11 @@
 #include <vector>
 #include <memory>
 
+#include "../../simulator/beam_state.h"
 #include "../../simulator/game.h"
+#include "../../simulator/memory_budget.h"
 #include "../../simulator/solver.h"
+#include "../../simulator/thread_pool.h"
 
 class KaminekoScorer : public GameScorer {
  public:
@@ -23,22 +26,60 @@ class Kamineko: public Solver2 {
   virtual ~Kamineko();
   virtual void AddGame(const Game& game);
   virtual bool Next(std::string* best_command, int* res_score);
+
+  // Command history shared among paths. Each node holds only the commands
+  // of one step and points to its parent, so a child path does not copy the
+  // whole history of its ancestors.
+  struct CommandChain {
+    std::shared_ptr<const CommandChain> parent;
+    std::string commands;
+    int depth;
+    size_t length;  // Total length of commands from the root to this node.
+    CommandChain(const std::shared_ptr<const CommandChain>& parent,
+                 const std::string& commands)
+      : parent(parent), commands(commands),
+        depth(parent ? parent->depth + 1 : 0),
+        length((parent ? parent->length : 0) + commands.size()) {}
+  };
+
   struct GamePath {
-    Game game;
+    std::shared_ptr<const BeamState> state;
     bool finished;
     int64_t score;
-    std::string commands;
+    int game_score;
+    size_t state_hash;
+    std::shared_ptr<const CommandChain> commands;
     std::string debug;
     GamePath() {}
-    GamePath(const Game& game, bool finished,
-             int64_t score, const std::string& commands,
+    GamePath(const std::shared_ptr<const BeamState>& state, const Game& game,
+             bool finished, int64_t score,
+             const std::shared_ptr<const CommandChain>& commands,
              const std::string& debug)
-      : game(game), finished(finished), score(score), commands(commands),
-        debug(debug) {}
+      : state(state), finished(finished), score(score),
+        game_score(game.score()), state_hash(game.StateHash()),
+        commands(commands), debug(debug) {}
   };
  private:
+  // Updates best_commands_ to the commands of the given chain. Only the part
+  // diverged from the previously materialized chain is rebuilt.
+  void MaterializeCommands(const std::shared_ptr<const CommandChain>& chain);
+
+  // Expands a path into the candidates of the next step. The candidates are
+  // kept as a min-heap bounded by |width|, and ones not scored higher than
+  // |threshold| are dropped.
+  void Expand(const GamePath& path, int width, int64_t threshold,
+              std::vector<std::unique_ptr<GamePath> >* candidates);
+
+  // Returns approximate bytes needed per unit of beam width.
+  int64_t GetBytesPerWidth() const;
+
   GameScorer* scorer_;
+  ThreadPool pool_;
+  BeamWidthController width_;
+  size_t state_bytes_;
   std::vector<std::unique_ptr<GamePath> > path_;
+  std::shared_ptr<const CommandChain> best_chain_;
+  std::string best_commands_;
 };
 
 #endif  // KAMINEKO_H__
@@ -4,10 +4,14 @@
 #include "kamineko.h"
 #include "../../simulator/solver.h"
 
+REGISTER_SOLVER2(kamineko, "Kamineko", [] { return new Kamineko(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver2(new Kamineko(), "Kamineko");
+  return RunSolver2([] { return new Kamineko(); }, "Kamineko");
 }
+#endif  // SOLVER_HOST
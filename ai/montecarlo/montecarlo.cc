@@ -1,103 +1,152 @@
+#include <atomic>
+#include <chrono>
 #include <random>
+#include <string>
+#include <vector>
 
-#include "../../simulator/solver.h"
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "../../simulator/board.h"
 #include "../../simulator/common.h"
+#include "../../simulator/game.h"
+#include "../../simulator/solver.h"
+#include "../../simulator/thread_pool.h"
+#include "rollout.h"
 
 
 DEFINE_int64(seed, 178116, "");
 DEFINE_int32(iteration, 15, "");
+DEFINE_int32(playout_units, 0,
+             "Units placed in a playout at most. 0 plays to the end.");
 
 namespace {
 
 class MontecarloSolver : public Solver {
  public:
-  MontecarloSolver(int seed, int iteration)
-      : current_(0), rand_(seed), iteration_(iteration) {}
+  MontecarloSolver(int seed, int iteration, int playout_units)
+      : current_(0), seed_(seed), iteration_(iteration),
+        playout_units_(playout_units), pool_(FLAGS_threads),
+        engines_(pool_.num_threads()) {}
   virtual ~MontecarloSolver() {}
 
   virtual std::string NextCommands(const Game& game) override {
-    LOG(ERROR) << "Current: " << current_;
+    VLOG(1) << "Current: " << current_;
     ++current_;
 
+    const auto start = std::chrono::steady_clock::now();
+    int64_t num_placed = 0;
+    for (const auto& engine : engines_) {
+      num_placed -= engine.num_placed();
+    }
     std::vector<Game::SearchResult> candidate_list;
     game.ReachableUnits(&candidate_list);
-    int max_score = 0;
+    std::vector<int64_t> scores = Run(game, candidate_list);
+    int64_t max_score = 0;
     const Game::SearchResult* result = nullptr;
-    for (const auto& candidate : candidate_list) {
-      int score = Run(game, candidate.second);
-      if (score > max_score) {
-        max_score = score;
-        result = &candidate;
+    for (int i = 0; i < candidate_list.size(); ++i) {
+      if (!result || scores[i] > max_score) {
+        max_score = scores[i];
+        result = &candidate_list[i];
       }
     }
+    const double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    for (const auto& engine : engines_) {
+      num_placed += engine.num_placed();
+    }
+    VLOG(1) << candidate_list.size() * iteration_ << " playouts, "
+            << num_placed / elapsed << " units/s";
     return Game::Commands2SimpleString(result->second);
   }
 
  private:
-  int Run(const Game& original_game,
-          const std::vector<Game::Command>& commands) {
-    Game base_game = original_game;
-    if (!base_game.RunSequence(commands)) {
-      return base_game.score();
-    }
+  // Returns the score of each candidate. The candidates, and then their
+  // playouts, are spread over the threads. Each playout has its own random
+  // stream derived from the seed, the move, the candidate and the playout,
+  // so the result does not depend on the number of threads.
+  std::vector<int64_t> Run(const Game& original_game,
+                           const std::vector<Game::SearchResult>& candidates) {
+    const int num_candidates = candidates.size();
+    std::vector<Game> base_games(num_candidates);
+    // Not vector<bool>, whose elements share words between the threads.
+    std::vector<char> finished(num_candidates);
+    std::vector<int64_t> scores(num_candidates);
+    pool_.ParallelFor(num_candidates, [&](int c) {
+        Game& base_game = base_games[c];
+        base_game = original_game;
+        finished[c] = !base_game.PlaceUnit(candidates[c].first);
+        scores[c] = finished[c] ? base_game.score() : Heuristic(base_game);
+      });
 
-    // Height score.
-    int height_score = 0;
-    {
-      const Board::Map& cells = base_game.GetBoard().cells();
-      for (size_t x = 0; x < base_game.GetBoard().width(); ++x) {
-        for (size_t y = 0; y < base_game.GetBoard().height(); ++y) {
-          if (cells[y][x]) {
-            height_score += y * y;
+    // Each thread takes playouts with its own engine.
+    const int num_playouts = num_candidates * iteration_;
+    std::vector<int64_t> playout_scores(num_playouts, 0);
+    std::atomic<int> next(0);
+    pool_.ParallelFor(engines_.size(), [&](int slot) {
+        RolloutEngine& engine = engines_[slot];
+        for (int k; (k = next++) < num_playouts;) {
+          const int c = k / iteration_;
+          if (finished[c]) {
+            continue;
           }
+          std::seed_seq seq {seed_, current_, c, k % iteration_};
+          std::mt19937 rand(seq);
+          playout_scores[k] =
+              engine.Playout(base_games[c], playout_units_, &rand);
         }
-      }
+      });
+    for (int k = 0; k < num_playouts; ++k) {
+      scores[k / iteration_] += playout_scores[k];
     }
+    return scores;
+  }
 
-    // Row cell score.
-    int row_score = 0;
-    {
-      const Board::Map& cells = base_game.GetBoard().cells();
-      for (size_t y = 0; y < cells.size(); ++y) {
-        int count = 0;
-        for (int i : cells[y]) {
-          count += i;
-        }
-        row_score += count * count;
-      }
-    }
+  static int64_t Heuristic(const Game& game) {
+    const Board& board = game.board();
 
-    int total_score = 0;
-    for (int i = 0; i < iteration_; ++i) {
-      Game dryrun = base_game;
-      while (true) {
-        std::vector<Game::SearchResult> candidate_list;
-        dryrun.ReachableUnits(&candidate_list);
-        std::uniform_int_distribution<> dist(0, candidate_list.size() - 1);
-        const Game::SearchResult& chosen = candidate_list[dist(rand_)];
-        if (!dryrun.RunSequence(chosen.second)) {
-          break;
+    // Height score.
+    int64_t height_score = 0;
+    // Row cell score.
+    int64_t row_score = 0;
+    for (int y = 0; y < board.height(); ++y) {
+      int count = 0;
+      for (int x = 0; x < board.width(); ++x) {
+        if (board(x, y)) {
+          height_score += y * y;
+          ++count;
         }
       }
-      total_score += dryrun.score();
+      row_score += count * count;
     }
-    return total_score + height_score + row_score;
+    return height_score + row_score;
   }
 
   int current_;
-  std::mt19937 rand_;
+  int seed_;
   int iteration_;
+  int playout_units_;
+  ThreadPool pool_;
+  std::vector<RolloutEngine> engines_;
   DISALLOW_COPY_AND_ASSIGN(MontecarloSolver);
 };
 
 }  // namespace
 
+static Solver* NewMontecarlo() {
+  return new MontecarloSolver(FLAGS_seed, FLAGS_iteration,
+                              FLAGS_playout_units);
+}
+
+REGISTER_SOLVER(montecarlo_solver, "Montecarlo", NewMontecarlo);
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
   LOG(INFO) << "Montecarlo Seed: " << FLAGS_seed;
-  return RunSolver(new MontecarloSolver(FLAGS_seed, FLAGS_iteration),
-                   "Montecarlo");
+  return RunSolver(NewMontecarlo, "Montecarlo");
 }
+#endif  // SOLVER_HOST
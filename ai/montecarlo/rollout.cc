@@ -0,0 +1,28 @@
+#include "rollout.h"
+
+#include <random>
+#include <vector>
+
+#include "../../simulator/game.h"
+#include "../../simulator/unit.h"
+
+RolloutEngine::RolloutEngine() : num_placed_(0) {}
+RolloutEngine::~RolloutEngine() {}
+
+int RolloutEngine::Playout(const Game& game, int max_units,
+                           std::mt19937* rand) {
+  // Assignment reuses the storage of the scratch game.
+  scratch_ = game;
+  for (int i = 0; max_units <= 0 || i < max_units; ++i) {
+    scratch_.ReachablePlacements(&buffer_, &placements_);
+    if (placements_.empty()) {
+      break;
+    }
+    std::uniform_int_distribution<int> dist(0, placements_.size() - 1);
+    ++num_placed_;
+    if (!scratch_.PlaceUnit(placements_[dist(*rand)])) {
+      break;
+    }
+  }
+  return scratch_.score();
+}
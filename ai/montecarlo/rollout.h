@@ -0,0 +1,35 @@
+#ifndef ROLLOUT_H_
+#define ROLLOUT_H_
+
+#include <random>
+#include <vector>
+
+#include "../../simulator/common.h"
+#include "../../simulator/game.h"
+#include "../../simulator/unit.h"
+
+// Plays games with uniformly random placements. The scratch game and the
+// buffers are reused, so playouts do not allocate once they have grown.
+// Not thread safe; use one per thread.
+class RolloutEngine {
+ public:
+  RolloutEngine();
+  ~RolloutEngine();
+
+  // Plays |game| until it finishes or |max_units| units are placed, and
+  // returns the score. |max_units| <= 0 means no limit.
+  int Playout(const Game& game, int max_units, std::mt19937* rand);
+
+  // Number of units placed by the playouts so far.
+  int64_t num_placed() const { return num_placed_; }
+
+ private:
+  Game scratch_;
+  Game::PlacementBuffer buffer_;
+  std::vector<UnitLocation> placements_;
+  int64_t num_placed_;
+
+  DISALLOW_COPY_AND_ASSIGN(RolloutEngine);
+};
+
+#endif  // ROLLOUT_H_
@@ -5,11 +5,19 @@
 #include "../kamineko/kamineko.h"
 #include "../../simulator/solver.h"
 
+static Solver2* NewOsaka() {
+  static Osaka osaka;
+  return new Kamineko(&osaka);
+}
+
+REGISTER_SOLVER2(osaka, "Osaka", NewOsaka);
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  Osaka osaka;
-  return RunSolver2(new Kamineko(&osaka), "Osaka");
+  return RunSolver2(NewOsaka, "Osaka");
 }
+#endif  // SOLVER_HOST
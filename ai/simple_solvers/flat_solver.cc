@@ -80,10 +80,14 @@ public:
   }
 };
 
+REGISTER_SOLVER(flat_solver, "Flat", [] { return new FlatSolver(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new FlatSolver(), "Flat");
+  return RunSolver([] { return new FlatSolver(); }, "Flat");
 }
+#endif  // SOLVER_HOST
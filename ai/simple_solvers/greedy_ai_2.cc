@@ -32,11 +32,15 @@ public:
   }
 };
 
+REGISTER_SOLVER(greedy_ai_2, "greedy_ai_2.cc", [] { return new GreedySolver2(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new GreedySolver2(), "greedy_ai_2.cc");
+  return RunSolver([] { return new GreedySolver2(); }, "greedy_ai_2.cc");
 }
+#endif  // SOLVER_HOST
 
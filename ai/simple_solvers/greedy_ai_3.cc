@@ -53,10 +53,14 @@ public:
   }
 };
 
+REGISTER_SOLVER(greedy_ai_3, "greedy_ai_3.cc", [] { return new GreedySolver3(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new GreedySolver3(), "greedy_ai_3.cc");
+  return RunSolver([] { return new GreedySolver3(); }, "greedy_ai_3.cc");
 }
+#endif  // SOLVER_HOST
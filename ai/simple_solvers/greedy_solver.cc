@@ -35,10 +35,14 @@ public:
 // ../../supervisors/simple.py -f problem.json ./greedy_solver
 // or
 // ../../supervisors/simple.py -f problem.json --show_scores ./greedy_solver
+REGISTER_SOLVER(greedy_solver, "GreedySolver", [] { return new GreedySolver(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new GreedySolver(), "GreedySolver");
+  return RunSolver([] { return new GreedySolver(); }, "GreedySolver");
 }
+#endif  // SOLVER_HOST
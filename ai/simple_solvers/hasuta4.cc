@@ -81,11 +81,15 @@ public:
   }
 };
 
+REGISTER_SOLVER(hasuta4, "hasuta4.cc", [] { return new Hasuta4(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new Hasuta4(), "hasuta4.cc");
+  return RunSolver([] { return new Hasuta4(); }, "hasuta4.cc");
 }
+#endif  // SOLVER_HOST
 
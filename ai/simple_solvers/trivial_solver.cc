@@ -599,10 +599,14 @@ public:
   }
 };
 
+REGISTER_SOLVER(trivial_solver, "Trivial", [] { return new TrivialSolver(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new TrivialSolver(), "Trivial");
+  return RunSolver([] { return new TrivialSolver(); }, "Trivial");
 }
+#endif  // SOLVER_HOST
@@ -215,11 +215,15 @@ private:
   }
 };
 
+REGISTER_SOLVER(yasaka, "Yasaka", [] { return new Yasaka(); });
+
+#ifndef SOLVER_HOST
 int main(int argc, char* argv[]) {
   google::InitGoogleLogging(argv[0]);
   google::ParseCommandLineFlags(&argc, &argv, true);
 
   FLAGS_logtostderr = true;
-  return RunSolver(new Yasaka(), "Yasaka");
+  return RunSolver([] { return new Yasaka(); }, "Yasaka");
 }
+#endif  // SOLVER_HOST
 
@@ -0,0 +1,35 @@
+#include <string>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "uct.h"
+#include "../kamineko/kamineko.h"
+#include "../osaka/osaka.h"
+#include "../../simulator/solver.h"
+
+DEFINE_string(uct_scorer, "osaka", "Leaf evaluator: osaka or kamineko.");
+
+static Solver2* NewUct() {
+  static Osaka osaka;
+  static KaminekoScorer kamineko;
+  GameScorer* scorer = &osaka;
+  if (FLAGS_uct_scorer == "kamineko") {
+    scorer = &kamineko;
+  } else {
+    CHECK_EQ("osaka", FLAGS_uct_scorer) << "Unknown scorer";
+  }
+  return new UctSolver(scorer);
+}
+
+REGISTER_SOLVER2(uct, "Uct", NewUct);
+
+#ifndef SOLVER_HOST
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  FLAGS_logtostderr = true;
+  return RunSolver2(NewUct, "Uct");
+}
+#endif  // SOLVER_HOST
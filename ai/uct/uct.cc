@@ -0,0 +1,210 @@
+#include "uct.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "../../simulator/game.h"
+#include "../../simulator/solver.h"
+#include "../../simulator/unit.h"
+
+DEFINE_int32(uct_iterations, 200, "Iterations of the tree search per move.");
+DEFINE_int32(uct_rollout_units, 0,
+             "Random placements before a leaf is scored.");
+DEFINE_double(uct_exploration, 0.3,
+              "Exploration constant of UCB1, on values normalized among "
+              "siblings.");
+DEFINE_int64(uct_seed, 1, "Seed of the rollouts.");
+
+UctSolver::UctSolver(GameScorer* scorer)
+  : scorer_(scorer), rand_(FLAGS_uct_seed), num_nodes_(0) {}
+
+UctSolver::~UctSolver() {}
+
+void UctSolver::AddGame(const Game& game) {
+  root_.reset(new Node(nullptr, game.current_unit()));
+  root_->game.reset(new Game(game));
+  root_->finished = game.is_finished();
+  commands_.clear();
+  num_nodes_ = 1;
+}
+
+int64_t UctSolver::Evaluate(const Game& game, bool finished) {
+  if (finished || FLAGS_uct_rollout_units <= 0) {
+    return scorer_->Score(game, finished, nullptr);
+  }
+  Game rollout(game);
+  for (int i = 0; i < FLAGS_uct_rollout_units; ++i) {
+    rollout.ReachablePlacements(&buffer_, &placements_);
+    if (placements_.empty()) {
+      break;
+    }
+    std::uniform_int_distribution<int> dist(0, placements_.size() - 1);
+    if (!rollout.PlaceUnit(placements_[dist(rand_)])) {
+      return scorer_->Score(rollout, true, nullptr);
+    }
+  }
+  return scorer_->Score(rollout, false, nullptr);
+}
+
+void UctSolver::Expand(Node* node) {
+  if (!node->game) {
+    node->game.reset(new Game(*node->parent->game));
+    node->game->PlaceUnit(node->location);
+  }
+  const Game& game = *node->game;
+  game.ReachablePlacements(&buffer_, &placements_);
+  // Evaluate() reuses placements_.
+  const std::vector<UnitLocation> placements(placements_);
+  Game child_game;
+  for (const auto& location : placements) {
+    std::unique_ptr<Node> child(new Node(node, location));
+    child_game = game;
+    child->finished = !child_game.PlaceUnit(location);
+    child->value = Evaluate(child_game, child->finished);
+    child->visits = 1;
+    node->children.push_back(std::move(child));
+  }
+  num_nodes_ += node->children.size();
+}
+
+UctSolver::Node* UctSolver::Select(Node* node) const {
+  int64_t min_value = std::numeric_limits<int64_t>::max();
+  int64_t max_value = std::numeric_limits<int64_t>::min();
+  for (const auto& child : node->children) {
+    if (!child->finished) {
+      min_value = std::min(min_value, child->value);
+      max_value = std::max(max_value, child->value);
+    }
+  }
+  const double range = std::max<double>(1, max_value - min_value);
+  const double log_visits = std::log(node->visits);
+  Node* best = nullptr;
+  double best_ucb = -std::numeric_limits<double>::infinity();
+  for (const auto& child : node->children) {
+    if (child->finished) {
+      continue;
+    }
+    const double ucb = (child->value - min_value) / range +
+        FLAGS_uct_exploration * std::sqrt(log_visits / child->visits);
+    if (ucb > best_ucb) {
+      best_ucb = ucb;
+      best = child.get();
+    }
+  }
+  return best;
+}
+
+void UctSolver::Iterate() {
+  Node* node = root_.get();
+  while (!node->children.empty()) {
+    Node* next = Select(node);
+    if (!next) {
+      // Every child finishes the game; nothing to search below.
+      break;
+    }
+    node = next;
+  }
+
+  int64_t value;
+  int visits;
+  if (node->finished || !node->children.empty()) {
+    value = node->value;
+    visits = 1;
+  } else {
+    Expand(node);
+    if (node->children.empty()) {
+      node->finished = true;
+      value = node->value;
+      visits = 1;
+    } else {
+      value = std::numeric_limits<int64_t>::min();
+      for (const auto& child : node->children) {
+        value = std::max(value, child->value);
+      }
+      visits = 1;
+    }
+  }
+  for (; node; node = node->parent) {
+    node->visits += visits;
+    if (node->visits == visits || value > node->value) {
+      node->value = value;
+    }
+  }
+}
+
+bool UctSolver::Next(std::string* best_command, int* res_score) {
+  const Game& game = *root_->game;
+  bool finished = root_->finished;
+  if (!finished) {
+    // The time for a move, when --deadline is given.
+    const double budget =
+        GetRemainingSeconds() / std::max(1, game.units_remaining());
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < FLAGS_uct_iterations; ++i) {
+      Iterate();
+      if (i % 16 == 15 && std::chrono::duration<double>(
+              std::chrono::steady_clock::now() - start).count() > budget) {
+        break;
+      }
+    }
+
+    // The child leading to the best line found. Ties go to the more
+    // visited one.
+    int best = -1;
+    for (int i = 0; i < root_->children.size(); ++i) {
+      const Node& child = *root_->children[i];
+      if (best < 0 || child.value > root_->children[best]->value ||
+          (child.value == root_->children[best]->value &&
+           child.visits > root_->children[best]->visits)) {
+        best = i;
+      }
+    }
+    if (best < 0) {
+      finished = true;
+    } else {
+      std::vector<Game::SearchResult> results;
+      game.ReachableUnits(&results);
+      CHECK(results[best].first == root_->children[best]->location);
+      commands_ += Game::Commands2SimpleString(results[best].second);
+      VLOG(1) << "nodes:" << num_nodes_ << " visits:" << root_->visits
+              << " chosen:" << root_->children[best]->visits
+              << " value:" << root_->children[best]->value;
+
+      // Keep the subtree of the chosen placement.
+      std::unique_ptr<Node> next_root(std::move(root_->children[best]));
+      if (!next_root->game) {
+        next_root->game.reset(new Game(game));
+        next_root->game->PlaceUnit(next_root->location);
+      }
+      next_root->parent = nullptr;
+      root_ = std::move(next_root);
+      finished = root_->finished;
+      num_nodes_ = 0;
+      std::vector<const Node*> todo = {root_.get()};
+      while (!todo.empty()) {
+        const Node* node = todo.back();
+        todo.pop_back();
+        ++num_nodes_;
+        for (const auto& child : node->children) {
+          todo.push_back(child.get());
+        }
+      }
+    }
+  }
+  if (best_command) {
+    *best_command = commands_;
+  }
+  if (res_score) {
+    *res_score = root_->game->score();
+  }
+  return finished;
+}
@@ -0,0 +1,60 @@
+#ifndef UCT_H__
+#define UCT_H__
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../simulator/game.h"
+#include "../../simulator/solver.h"
+#include "../../simulator/unit.h"
+
+// Monte Carlo tree search over placements with UCB1 selection. A leaf is
+// evaluated by the scorer after a short random rollout. The subtree under
+// the chosen placement is kept for the next move.
+class UctSolver : public Solver2 {
+ public:
+  explicit UctSolver(GameScorer* scorer);
+  virtual ~UctSolver();
+  virtual void AddGame(const Game& game);
+  virtual bool Next(std::string* best_command, int* res_score);
+
+ private:
+  struct Node {
+    Node* parent;
+    UnitLocation location;  // Placement from the parent.
+    bool finished;
+    // The best evaluation below this node. The game is deterministic and
+    // single player, so the best line matters rather than the average.
+    int64_t value;
+    int visits;
+    // Only expanded nodes keep their game. Children are in the order of
+    // Game::ReachableUnits().
+    std::unique_ptr<Game> game;
+    std::vector<std::unique_ptr<Node> > children;
+
+    Node(Node* parent, const UnitLocation& location)
+      : parent(parent), location(location), finished(false), value(0),
+        visits(0) {}
+  };
+
+  // Runs one iteration of selection, expansion and backup.
+  void Iterate();
+  Node* Select(Node* node) const;
+  // Creates and evaluates all the children of |node|.
+  void Expand(Node* node);
+  int64_t Evaluate(const Game& game, bool finished);
+
+  GameScorer* scorer_;
+  std::mt19937 rand_;
+  Game::PlacementBuffer buffer_;
+  std::vector<UnitLocation> placements_;
+  std::unique_ptr<Node> root_;
+  std::string commands_;
+  int num_nodes_;
+
+  DISALLOW_COPY_AND_ASSIGN(UctSolver);
+};
+
+#endif  // UCT_H__
@@ -0,0 +1,29 @@
+#----------------------------------------------------------------
+# Generated CMake target import file.
+#----------------------------------------------------------------
+
+# Commands may need to know the format version.
+set(CMAKE_IMPORT_FILE_VERSION 1)
+
+# Import target "gflags-static" for configuration ""
+set_property(TARGET gflags-static APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(gflags-static PROPERTIES
+  IMPORTED_LINK_INTERFACE_LANGUAGES_NOCONFIG "CXX"
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libgflags.a"
+  )
+
+list(APPEND _cmake_import_check_targets gflags-static )
+list(APPEND _cmake_import_check_files_for_gflags-static "${_IMPORT_PREFIX}/lib/libgflags.a" )
+
+# Import target "gflags_nothreads-static" for configuration ""
+set_property(TARGET gflags_nothreads-static APPEND PROPERTY IMPORTED_CONFIGURATIONS NOCONFIG)
+set_target_properties(gflags_nothreads-static PROPERTIES
+  IMPORTED_LINK_INTERFACE_LANGUAGES_NOCONFIG "CXX"
+  IMPORTED_LOCATION_NOCONFIG "${_IMPORT_PREFIX}/lib/libgflags_nothreads.a"
+  )
+
+list(APPEND _cmake_import_check_targets gflags_nothreads-static )
+list(APPEND _cmake_import_check_files_for_gflags_nothreads-static "${_IMPORT_PREFIX}/lib/libgflags_nothreads.a" )
+
+# Commands beyond this point should not need to know the version.
+set(CMAKE_IMPORT_FILE_VERSION)
@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/third_party/gflags/src/gflags.cc" "CMakeFiles/gflags-static.dir/src/gflags.cc.o" "gcc" "CMakeFiles/gflags-static.dir/src/gflags.cc.o.d"
+  "/root/repo/third_party/gflags/src/gflags_completions.cc" "CMakeFiles/gflags-static.dir/src/gflags_completions.cc.o" "gcc" "CMakeFiles/gflags-static.dir/src/gflags_completions.cc.o.d"
+  "/root/repo/third_party/gflags/src/gflags_reporting.cc" "CMakeFiles/gflags-static.dir/src/gflags_reporting.cc.o" "gcc" "CMakeFiles/gflags-static.dir/src/gflags_reporting.cc.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
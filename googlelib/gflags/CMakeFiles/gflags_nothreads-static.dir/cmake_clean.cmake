@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/gflags_nothreads-static.dir/src/gflags.cc.o"
+  "CMakeFiles/gflags_nothreads-static.dir/src/gflags.cc.o.d"
+  "CMakeFiles/gflags_nothreads-static.dir/src/gflags_completions.cc.o"
+  "CMakeFiles/gflags_nothreads-static.dir/src/gflags_completions.cc.o.d"
+  "CMakeFiles/gflags_nothreads-static.dir/src/gflags_reporting.cc.o"
+  "CMakeFiles/gflags_nothreads-static.dir/src/gflags_reporting.cc.o.d"
+  "lib/libgflags_nothreads.a"
+  "lib/libgflags_nothreads.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/gflags_nothreads-static.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
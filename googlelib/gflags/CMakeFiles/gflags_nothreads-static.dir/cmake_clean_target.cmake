@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "lib/libgflags_nothreads.a"
+)
@@ -0,0 +1,65 @@
+#include "beam_state.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <glog/logging.h>
+
+DEFINE_int32(beam_checkpoint_interval, 8,
+             "Beam states keep their games every this number of steps.");
+
+BeamState::BeamState(const Game& game)
+  : depth_(0), game_(new Game(game)) {
+}
+
+BeamState::BeamState(const std::shared_ptr<const BeamState>& parent,
+                     const UnitLocation& location)
+  : parent_(parent), location_(location), depth_(parent->depth_ + 1) {
+  if (IsCheckpoint()) {
+    Game* game = new Game();
+    Restore(game);
+    game_.reset(game);
+    // Restore() stops here, so the ancestors are not needed any more.
+    parent_.reset();
+  }
+}
+
+BeamState::BeamState(const std::shared_ptr<const BeamState>& parent,
+                     const UnitLocation& location,
+                     const Game& game)
+  : parent_(parent), location_(location), depth_(parent->depth_ + 1) {
+  if (IsCheckpoint()) {
+    game_.reset(new Game(game));
+    parent_.reset();
+  }
+}
+
+BeamState::~BeamState() {
+}
+
+bool BeamState::IsCheckpoint() const {
+  return FLAGS_beam_checkpoint_interval <= 1 ||
+      depth_ % FLAGS_beam_checkpoint_interval == 0;
+}
+
+size_t BeamState::ApproxMemoryUsage(const Game& game) {
+  // States are allocated with make_shared, and the control block is next to
+  // the state.
+  const size_t kControlBlockSize = 2 * sizeof(void*) + 2 * sizeof(int);
+  return sizeof(BeamState) + kControlBlockSize +
+      game.ApproxMemoryUsage() / std::max(1, FLAGS_beam_checkpoint_interval);
+}
+
+void BeamState::Restore(Game* game) const {
+  std::vector<const BeamState*> path;
+  const BeamState* state = this;
+  while (!state->game_) {
+    path.push_back(state);
+    state = state->parent_.get();
+    DCHECK(state);
+  }
+  *game = *state->game_;
+  for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+    game->PlaceUnit((*iter)->location_);
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef BEAM_STATE_H_
+#define BEAM_STATE_H_
+
+#include <memory>
+
+#include <gflags/gflags.h>
+
+#include "common.h"
+#include "game.h"
+#include "unit.h"
+
+DECLARE_int32(beam_checkpoint_interval);
+
+// Compact game state for beam search.
+// A state keeps only the location where the unit was locked from its parent.
+// The game is rebuilt on demand by replaying the locations from the nearest
+// ancestor which keeps its game. Roots and every
+// --beam_checkpoint_interval-th generation keep their games, and drop their
+// parents so that at most one checkpoint per line is alive.
+class BeamState {
+ public:
+  // Creates a root state keeping the game.
+  explicit BeamState(const Game& game);
+  // Creates a state reached from the parent by locking the current unit at
+  // the location. The game is rebuilt if this is a checkpoint.
+  BeamState(const std::shared_ptr<const BeamState>& parent,
+            const UnitLocation& location);
+  // Same as above, but takes the game after the lock, to avoid rebuilding.
+  BeamState(const std::shared_ptr<const BeamState>& parent,
+            const UnitLocation& location,
+            const Game& game);
+  ~BeamState();
+
+  int depth() const { return depth_; }
+  bool has_game() const { return game_ != nullptr; }
+
+  // Rebuilds the game of this state into |game|.
+  void Restore(Game* game) const;
+
+  // Approximate bytes used by a state, including its share of the games
+  // kept at checkpoints.
+  static size_t ApproxMemoryUsage(const Game& game);
+
+ private:
+  bool IsCheckpoint() const;
+
+  // Null in states keeping their games.
+  std::shared_ptr<const BeamState> parent_;
+  UnitLocation location_;
+  int depth_;
+  std::unique_ptr<const Game> game_;
+
+  DISALLOW_COPY_AND_ASSIGN(BeamState);
+};
+
+#endif  // BEAM_STATE_H_
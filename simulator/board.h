@@ -1,6 +1,7 @@
 #ifndef BOARD_H_
 #define BOARD_H_
 
+#include <functional>
 #include <iostream>
 #include <vector>
 
@@ -37,6 +38,13 @@ class Board {
 
   void Load(const picojson::value& parsed);
 
+  // Hash of the filled cells.
+  size_t Hash() const { return std::hash<Map>()(cells_); }
+  bool operator==(const Board& other) const {
+    return width_ == other.width_ && cells_ == other.cells_;
+  }
+  bool operator!=(const Board& other) const { return !(*this == other); }
+
   bool IsConflicting(const UnitLocation& unit) const;
   int Lock(const UnitLocation& unit);
   int LockPreview(const UnitLocation& unit) const;
@@ -0,0 +1,232 @@
+#include "endgame.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "game.h"
+#include "scorer.h"
+#include "solver.h"
+
+DEFINE_int32(endgame_units, 0,
+             "Finishes the best line exhaustively once it has this many "
+             "units or less to place. 0 disables it.");
+DEFINE_int64(endgame_max_nodes, 200000,
+             "States the endgame search may visit for a move.");
+
+namespace {
+
+// Entries keep boards, so this is less than a million.
+const size_t kMaxTableEntries = 1 << 18;
+
+}  // namespace
+
+EndgameSolver::EndgameSolver(int64_t max_nodes)
+  : max_nodes_(max_nodes), num_nodes_(0), max_unit_size_(0) {}
+
+EndgameSolver::~EndgameSolver() {}
+
+int64_t EndgameSolver::UpperBound(const Game& game) const {
+  const Board& board = game.board();
+  int filled = 0;
+  for (int y = 0; y < board.height(); ++y) {
+    for (int x = 0; x < board.width(); ++x) {
+      filled += board(x, y);
+    }
+  }
+  // A unit clears at most as many lines as its cells, and each line takes
+  // the width of cells on the board.
+  const int64_t num_units = game.units_remaining() + 1;
+  const int64_t max_lines = max_unit_size_;
+  const int64_t lines = std::min<int64_t>(
+      num_units * max_lines,
+      (filled + num_units * max_unit_size_) / board.width());
+  // ls * (ls + 1) / 2 <= ls * (max_lines + 1) / 2, and the bonus of the
+  // previous lines is at most (max_lines - 1) / 10 of the points.
+  const int64_t points =
+      num_units * max_unit_size_ + 100 * lines * (max_lines + 1) / 2;
+  return points * (10 + std::max<int64_t>(0, max_lines - 1)) / 10;
+}
+
+void EndgameSolver::Expand(const Game& game,
+                           std::vector<std::pair<int, Game> >* children) {
+  game.ReachablePlacements(&buffer_, &placements_);
+  children->resize(placements_.size());
+  for (int i = 0; i < placements_.size(); ++i) {
+    (*children)[i].first = i;
+    Game& child = (*children)[i].second;
+    child = game;
+    child.PlaceUnit(placements_[i]);
+  }
+  std::stable_sort(children->begin(), children->end(),
+                   [](const std::pair<int, Game>& lhs,
+                      const std::pair<int, Game>& rhs) {
+                     return lhs.second.score() > rhs.second.score();
+                   });
+}
+
+int64_t EndgameSolver::Search(const Game& game, int64_t alpha) {
+  if (game.is_finished() || num_nodes_ > max_nodes_) {
+    return 0;
+  }
+  ++num_nodes_;
+  const size_t key = game.StateHash();
+  auto it = table_.find(key);
+  if (it != table_.end() && game.HasState(it->second.state) &&
+      (it->second.exact || it->second.gain < alpha)) {
+    return it->second.gain;
+  }
+
+  std::vector<std::pair<int, Game> > children;
+  Expand(game, &children);
+  const int64_t initial_alpha = alpha;
+  int64_t best = std::numeric_limits<int64_t>::min();
+  for (const auto& child : children) {
+    const int64_t gain = child.second.score() - game.score();
+    if (!child.second.is_finished() &&
+        gain + UpperBound(child.second) < alpha) {
+      continue;
+    }
+    const int64_t total = gain + Search(child.second, alpha - gain);
+    if (total > best) {
+      best = total;
+      alpha = std::max(alpha, best);
+    }
+  }
+  if (children.empty()) {
+    best = 0;
+  }
+  // Gains are not negative, so this does not overflow the callers.
+  best = std::max(best, initial_alpha - 1);
+  if (num_nodes_ <= max_nodes_) {
+    if (table_.size() >= kMaxTableEntries) {
+      table_.clear();
+    }
+    TableEntry& entry = table_[key];
+    entry.state = game.GetStateKey();
+    entry.exact = best >= initial_alpha;
+    entry.gain = entry.exact ? best : initial_alpha - 1;
+  }
+  return best;
+}
+
+bool EndgameSolver::Solve(const Game& game, std::string* commands,
+                          int* final_score) {
+  if (max_unit_size_ == 0) {
+    for (const auto& unit : game.units()) {
+      max_unit_size_ = std::max<int>(max_unit_size_, unit.members().size());
+    }
+  }
+  num_nodes_ = 0;
+  std::vector<std::pair<int, Game> > children;
+  Expand(game, &children);
+  // Ties go to the placement found first by ReachableUnits().
+  int64_t alpha = 0;
+  int best_index = -1;
+  for (const auto& child : children) {
+    const int64_t gain = child.second.score() - game.score();
+    if (!child.second.is_finished() &&
+        gain + UpperBound(child.second) < alpha) {
+      continue;
+    }
+    const int64_t total = gain + Search(child.second, alpha - gain);
+    if (best_index < 0 || total > alpha ||
+        (total == alpha && child.first < best_index)) {
+      alpha = total;
+      best_index = child.first;
+    }
+  }
+  if (num_nodes_ > max_nodes_ || best_index < 0) {
+    return false;
+  }
+  std::vector<Game::SearchResult> results;
+  game.ReachableUnits(&results);
+  *commands = Game::Commands2SimpleString(results[best_index].second);
+  *final_score = game.score() + alpha;
+  return true;
+}
+
+EndgameTailSolver::EndgameTailSolver(Solver2* solver)
+  : solver_(solver), endgame_(FLAGS_endgame_max_nodes), gave_up_(false) {}
+
+EndgameTailSolver::~EndgameTailSolver() {}
+
+void EndgameTailSolver::AddGame(const Game& game) {
+  solver_->AddGame(game);
+  initial_game_ = game;
+  game_ = game;
+  commands_.clear();
+  gave_up_ = false;
+}
+
+void EndgameTailSolver::Finish() {
+  solver_->Finish();
+}
+
+bool EndgameTailSolver::Next(std::string* best_command, int* score) {
+  std::string commands;
+  int solver_score = 0;
+  const bool finished = solver_->Next(&commands, &solver_score);
+  if (finished || gave_up_) {
+    if (best_command) {
+      *best_command = commands;
+    }
+    if (score) {
+      *score = solver_score;
+    }
+    return finished;
+  }
+
+  // Follow the best line of the solver, replaying only the new part if it
+  // extends the previous one.
+  if (commands.compare(0, commands_.size(), commands_) != 0) {
+    game_ = initial_game_;
+    commands_.clear();
+  }
+  for (size_t i = commands_.size(); i < commands.size(); ++i) {
+    game_.Run(Game::Char2Command(commands[i]));
+  }
+  commands_ = commands;
+  if (best_command) {
+    *best_command = commands;
+  }
+  if (score) {
+    *score = solver_score;
+  }
+  if (game_.is_finished() || game_.error() ||
+      game_.units_remaining() + 1 > FLAGS_endgame_units) {
+    return false;
+  }
+
+  // Finish the line. Later moves mostly hit the table of the first one.
+  Game game(game_);
+  std::string tail;
+  int final_score = game.score();
+  while (!game.is_finished()) {
+    std::string move;
+    if (!endgame_.Solve(game, &move, &final_score)) {
+      LOG(INFO) << "Endgame search gave up at " << game.units_remaining()
+                << " units left";
+      gave_up_ = true;
+      return false;
+    }
+    for (char c : move) {
+      game.Run(Game::Char2Command(c));
+    }
+    tail += move;
+  }
+  VLOG(1) << "Endgame: " << solver_score << " -> " << game.score();
+  if (best_command) {
+    *best_command = commands + tail;
+  }
+  if (score) {
+    *score = game.score();
+  }
+  return true;
+}
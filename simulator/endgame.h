@@ -0,0 +1,86 @@
+#ifndef ENDGAME_H_
+#define ENDGAME_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "common.h"
+#include "game.h"
+#include "solver.h"
+#include "unit.h"
+
+DECLARE_int32(endgame_units);
+DECLARE_int64(endgame_max_nodes);
+
+// Exhaustive search for the placements maximizing the final score. The
+// units to come are fixed by the seed, so the result is exact, apart from
+// power phrases.
+class EndgameSolver {
+ public:
+  // The search gives up after visiting |max_nodes| states in a call.
+  explicit EndgameSolver(int64_t max_nodes);
+  ~EndgameSolver();
+
+  // Sets the commands to lock the current unit on the best line, and the
+  // final score of the line. Returns false if the search gave up.
+  bool Solve(const Game& game, std::string* commands, int* final_score);
+
+ private:
+  // Best score gain until the end. Subtrees which cannot reach |alpha| are
+  // pruned, so a result less than |alpha| only tells that the best is less
+  // than |alpha|.
+  int64_t Search(const Game& game, int64_t alpha);
+  // Upper bound of the score gain until the end.
+  int64_t UpperBound(const Game& game) const;
+  // Places the current unit at each reachable location. Children are
+  // ordered by the score gain, best first, and ties keep the order of
+  // Game::ReachableUnits().
+  void Expand(const Game& game, std::vector<std::pair<int, Game> >* children);
+
+  // Best gain, or an upper bound of it if not exact. Keyed by
+  // Game::StateHash(), and a hit is confirmed by the state.
+  struct TableEntry {
+    Game::StateKey state;
+    int64_t gain;
+    bool exact;
+  };
+
+  int64_t max_nodes_;
+  int64_t num_nodes_;
+  int max_unit_size_;
+  std::unordered_map<size_t, TableEntry> table_;
+  Game::PlacementBuffer buffer_;
+  std::vector<UnitLocation> placements_;
+
+  DISALLOW_COPY_AND_ASSIGN(EndgameSolver);
+};
+
+// Runs another solver, and once its best line has at most
+// --endgame_units units to place, finishes that line with EndgameSolver.
+// Falls back to the solver if the endgame search gives up.
+class EndgameTailSolver : public Solver2 {
+ public:
+  explicit EndgameTailSolver(Solver2* solver);
+  virtual ~EndgameTailSolver();
+
+  virtual void AddGame(const Game& game);
+  virtual bool Next(std::string* best_command, int* score);
+  virtual void Finish();
+
+ private:
+  Solver2* solver_;
+  EndgameSolver endgame_;
+  Game initial_game_;
+  // The best line of the solver so far, and the game after it.
+  std::string commands_;
+  Game game_;
+  bool gave_up_;
+
+  DISALLOW_COPY_AND_ASSIGN(EndgameTailSolver);
+};
+
+#endif  // ENDGAME_H_
@@ -364,6 +364,83 @@ bool Game::RunSequence(const std::vector<Command>& commands) {
   return true;
 }
 
+bool Game::PlaceUnit(const UnitLocation& location) {
+  if (error_) {
+    return false;
+  }
+  if (is_finished_) {
+    error_ = true;
+    score_ = 0;
+    return false;
+  }
+
+  current_unit_ = location;
+  int num_cleared_lines = board_.Lock(current_unit_);
+  score_ += MoveScore(current_unit_.members().size(),
+                      num_cleared_lines, prev_cleared_lines_);
+  prev_cleared_lines_ = num_cleared_lines;
+  return SpawnNewUnit();
+}
+
+void Game::ReachablePlacements(PlacementBuffer* buffer,
+                               std::vector<UnitLocation>* result) const {
+  result->clear();
+  Bound bound;
+  for (int i = 0; i < data_->units().size(); ++i) {
+    if (current_unit_.unit() == &data_->units()[i]) {
+      bound = data_->unit_pivot_bounds()[i];
+    }
+  }
+  const int pivot_width = bound.right - bound.left + 1;
+  const int pivot_height = bound.bottom - bound.top + 1;
+  const int unit_order = current_unit_.unit()->order();
+  // Whether each location is unknown, free or conflicting. Conflicts are
+  // checked once per location, and tell also whether the neighbors lock.
+  enum { UNKNOWN = 0, FREE, CONFLICTING };
+  std::vector<uint8_t>& state = buffer->state;
+  state.assign(pivot_width * pivot_height * unit_order, UNKNOWN);
+  {
+    int x = current_unit_.pivot().x() - bound.left;
+    int y = current_unit_.pivot().y() - bound.top;
+    state[(y * pivot_width + x) * unit_order + current_unit_.angle()] = FREE;
+  }
+
+  // Breadth first, as ReachableUnits(). A location is added when it is
+  // expanded, which is in the order it was found.
+  std::vector<UnitLocation>& todo = buffer->todo;
+  todo.clear();
+  todo.push_back(current_unit_);
+  for (size_t head = 0; head < todo.size(); ++head) {
+    const UnitLocation current = todo[head];
+    bool lockable = false;
+    for (Command c = Command::E; c != Command::IGNORED; ++c) {
+      UnitLocation next = Game::NextUnit(current, c);
+      int x = next.pivot().x() - bound.left;
+      int y = next.pivot().y() - bound.top;
+      // Out of the bound, the unit does not fit in the board.
+      if (static_cast<unsigned int>(x) >= pivot_width ||
+          static_cast<unsigned int>(y) >= pivot_height) {
+        lockable = true;
+        continue;
+      }
+      uint8_t& next_state =
+          state[(y * pivot_width + x) * unit_order + next.angle()];
+      if (next_state == UNKNOWN) {
+        if (board_.IsConflicting(next)) {
+          next_state = CONFLICTING;
+        } else {
+          next_state = FREE;
+          todo.push_back(next);
+        }
+      }
+      lockable |= next_state == CONFLICTING;
+    }
+    if (lockable) {
+      result->push_back(current);
+    }
+  }
+}
+
 bool Game::IsLockableBy(const UnitLocation& current, Command cmd) const {
   UnitLocation new_unit = Game::NextUnit(current, cmd);
   return board_.IsConflicting(new_unit);
@@ -486,6 +563,35 @@ void Game::ReachableUnits(std::vector<SearchResult>* result) const {
   return;
 }
 
+size_t Game::StateHash() const {
+  size_t result = board_.Hash();
+  result = result * 1000003 + current_index_;
+  result = result * 1000003 + prev_cleared_lines_;
+  return result;
+}
+
+Game::StateKey Game::GetStateKey() const {
+  return StateKey {board_, current_index_, prev_cleared_lines_};
+}
+
+bool Game::HasState(const StateKey& key) const {
+  return current_index_ == key.current_index &&
+      prev_cleared_lines_ == key.prev_cleared_lines &&
+      board_ == key.board;
+}
+
+bool Game::HasSameState(const Game& other) const {
+  return current_index_ == other.current_index_ &&
+      prev_cleared_lines_ == other.prev_cleared_lines_ &&
+      board_ == other.board_;
+}
+
+size_t Game::ApproxMemoryUsage() const {
+  // Board cells are packed into bits.
+  return sizeof(Game) + (board_.width() * board_.height() + 7) / 8 +
+      history_.capacity() * sizeof(UnitLocation);
+}
+
 void Game::Dump(std::ostream* os) const {
   *os << "current_index: " << current_index_ << "\n";
   *os << "Rand: " << rand_.current() << "\n";
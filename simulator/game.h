@@ -90,6 +90,10 @@ class Game {
 
   bool Run(Command action);
   bool RunSequence(const std::vector<Command>& actions);
+  // Locks the current unit at the given location and spawns the next unit,
+  // as RunSequence does for the commands returned by ReachableUnits. The
+  // location is not checked, so it must be one of ReachableUnits' results.
+  bool PlaceUnit(const UnitLocation& location);
 
   // Given the current unit position, returns a command to lock the unit
   // at the position, or returns IGNORED if it's impossible to lock it.
@@ -103,6 +107,16 @@ class Game {
   // Does BFS search from current_unit_ to return the list of lockable locations
   // with the command sequence to reach there.
   void ReachableUnits(std::vector<SearchResult>* result) const;
+
+  // Buffers for ReachablePlacements(), which can be reused among calls.
+  struct PlacementBuffer {
+    std::vector<uint8_t> state;
+    std::vector<UnitLocation> todo;
+  };
+  // Same locations as ReachableUnits() in the same order, without the paths
+  // to them. Allocates nothing once |buffer| and |result| have grown.
+  void ReachablePlacements(PlacementBuffer* buffer,
+                           std::vector<UnitLocation>* result) const;
   const Board& board() const { return board_; }
 
   const UnitLocation& current_unit() const { return current_unit_; }
@@ -116,6 +130,27 @@ class Game {
 
   const int prev_cleared_lines() const { return prev_cleared_lines_; }
 
+  // Hash of the state which affects the rest of the game, i.e. the board,
+  // the index of the current unit and the line clear bonus. The score so far
+  // is not included, so games reaching the same position by different paths
+  // have the same hash.
+  size_t StateHash() const;
+
+  // The state hashed by StateHash(). Tables keyed by the hash keep it to
+  // tell a collision from a hit.
+  struct StateKey {
+    Board board;
+    int current_index;
+    int prev_cleared_lines;
+  };
+  StateKey GetStateKey() const;
+  bool HasState(const StateKey& key) const;
+  // Returns whether the games have the same state hashed by StateHash().
+  bool HasSameState(const Game& other) const;
+
+  // Approximate bytes used by this game.
+  size_t ApproxMemoryUsage() const;
+
  private:
   const GameData* data_;
   Board board_;
@@ -0,0 +1,87 @@
+#include <fstream>
+
+#include <gtest/gtest.h>
+#include <picojson.h>
+
+#include "game.h"
+
+namespace {
+
+void LoadGameData(const std::string& path, GameData* data) {
+  std::ifstream in(path);
+  picojson::value problem;
+  in >> problem;
+  ASSERT_TRUE(in.good()) << picojson::get_last_error();
+  data->Load(problem);
+}
+
+}  // namespace
+
+TEST(GameTest, PlaceUnitIsSameAsRunSequence) {
+  GameData data;
+  LoadGameData("../problems/problem_6.json", &data);
+
+  Game game;
+  game.Init(&data, 0);
+  while (!game.is_finished()) {
+    std::vector<Game::SearchResult> results;
+    game.ReachableUnits(&results);
+    ASSERT_FALSE(results.empty());
+    for (const auto& result : results) {
+      Game by_commands(game);
+      Game by_location(game);
+      EXPECT_EQ(by_commands.RunSequence(result.second),
+                by_location.PlaceUnit(result.first));
+      EXPECT_EQ(by_commands.score(), by_location.score());
+      EXPECT_EQ(by_commands.is_finished(), by_location.is_finished());
+      EXPECT_EQ(by_commands.StateHash(), by_location.StateHash());
+    }
+    // Proceed with the last candidate, which tends to be the deepest one.
+    game.PlaceUnit(results.back().first);
+  }
+}
+
+TEST(GameTest, ReachablePlacementsIsSameAsReachableUnits) {
+  for (const char* path : {"../problems/problem_3.json",
+                           "../problems/problem_6.json",
+                           "../problems/problem_17.json"}) {
+    GameData data;
+    LoadGameData(path, &data);
+
+    Game game;
+    game.Init(&data, 0);
+    Game::PlacementBuffer buffer;
+    std::vector<UnitLocation> placements;
+    while (!game.is_finished()) {
+      std::vector<Game::SearchResult> results;
+      game.ReachableUnits(&results);
+      game.ReachablePlacements(&buffer, &placements);
+      ASSERT_EQ(results.size(), placements.size()) << path;
+      for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_TRUE(results[i].first == placements[i]) << path;
+      }
+      game.PlaceUnit(placements.back());
+    }
+  }
+}
+
+TEST(GameTest, StateKeyTellsStatesApart) {
+  GameData data;
+  LoadGameData("../problems/problem_6.json", &data);
+
+  Game game;
+  game.Init(&data, 0);
+  std::vector<Game::SearchResult> results;
+  game.ReachableUnits(&results);
+  ASSERT_GE(results.size(), 2U);
+  Game first(game);
+  Game second(game);
+  first.PlaceUnit(results.front().first);
+  second.PlaceUnit(results.back().first);
+
+  EXPECT_TRUE(game.HasState(game.GetStateKey()));
+  EXPECT_TRUE(first.HasSameState(Game(first)));
+  EXPECT_FALSE(first.HasSameState(second));
+  EXPECT_FALSE(first.HasState(second.GetStateKey()));
+  EXPECT_FALSE(game.HasSameState(first));
+}
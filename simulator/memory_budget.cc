@@ -0,0 +1,129 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include <glog/logging.h>
+
+#include "solver.h"
+
+namespace {
+
+// Part of the limit used for beams. The rest is for the allocator overhead
+// and everything not accounted.
+const double kBeamMemoryRatio = 0.5;
+
+// The supervisor puts this process into the cgroup after it starts, so the
+// cgroup limit is read again after this interval.
+const int kCgroupRereadSeconds = 5;
+
+// Returns the path of the memory cgroup of this process, or "" if unknown.
+// The second returned value is whether it is cgroup v2.
+std::string GetMemoryCgroupPath(bool* is_v2) {
+  std::ifstream in("/proc/self/cgroup");
+  std::string line;
+  std::string v2_path;
+  while (std::getline(in, line)) {
+    // Each line is "hierarchy-ID:controller-list:cgroup-path".
+    std::string::size_type first = line.find(':');
+    std::string::size_type second = line.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos) {
+      continue;
+    }
+    std::string controllers = line.substr(first + 1, second - first - 1);
+    std::string path = line.substr(second + 1);
+    std::istringstream controller_list(controllers);
+    std::string controller;
+    while (std::getline(controller_list, controller, ',')) {
+      if (controller == "memory") {
+        *is_v2 = false;
+        return "/sys/fs/cgroup/memory" + path;
+      }
+    }
+    if (controllers.empty()) {
+      v2_path = "/sys/fs/cgroup" + path;
+    }
+  }
+  *is_v2 = true;
+  return v2_path;
+}
+
+int64_t ReadCgroupMemoryLimit() {
+  bool is_v2;
+  std::string path = GetMemoryCgroupPath(&is_v2);
+  if (path.empty()) {
+    return 0;
+  }
+  std::ifstream in(path + (is_v2 ? "/memory.max" : "/memory.limit_in_bytes"));
+  int64_t limit;
+  if (!(in >> limit)) {
+    // "max" in cgroup v2 means unlimited.
+    return 0;
+  }
+  // Unlimited cgroup v1 reports a huge value.
+  if (limit >= (int64_t(1) << 50)) {
+    return 0;
+  }
+  return limit;
+}
+
+int64_t GetCgroupMemoryLimit() {
+  typedef std::chrono::steady_clock Clock;
+  static std::mutex mutex;
+  static bool has_limit = false;
+  static Clock::time_point read_time;
+  static int64_t limit;
+  std::lock_guard<std::mutex> lock(mutex);
+  const Clock::time_point now = Clock::now();
+  if (!has_limit ||
+      now - read_time >= std::chrono::seconds(kCgroupRereadSeconds)) {
+    limit = ReadCgroupMemoryLimit();
+    read_time = now;
+    has_limit = true;
+  }
+  return limit;
+}
+
+}  // namespace
+
+int64_t GetMemoryLimit() {
+  if (FLAGS_memory_limit_mb > 0) {
+    return FLAGS_memory_limit_mb * 1024 * 1024;
+  }
+  return GetCgroupMemoryLimit();
+}
+
+BeamWidthController::BeamWidthController(int initial_width, int max_width)
+  : width_(initial_width),
+    max_width_(max_width > 0 ? max_width : initial_width),
+    fitting_width_(0) {
+}
+
+void BeamWidthController::Update(int64_t bytes_per_width) {
+  if (bytes_per_width <= 0) {
+    return;
+  }
+  // Games solved together share the limit.
+  int64_t limit = GetMemoryLimit() / NumConcurrentGames();
+  if (limit <= 0) {
+    return;
+  }
+  int64_t fit = static_cast<int64_t>(limit * kBeamMemoryRatio) /
+      bytes_per_width;
+  fitting_width_ = static_cast<int>(std::max<int64_t>(
+      1, std::min<int64_t>(fit, std::numeric_limits<int>::max())));
+  int new_width = static_cast<int>(std::min<int64_t>(fit, max_width_));
+  new_width = std::min(new_width, width_ + std::max(1, width_ / 2));
+  new_width = std::max(new_width, 1);
+  if (new_width != width_) {
+    VLOG(1) << "Beam width: " << width_ << " -> " << new_width
+            << " (" << bytes_per_width << " bytes/width, limit "
+            << limit << ")";
+    width_ = new_width;
+  }
+}
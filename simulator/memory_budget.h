@@ -0,0 +1,39 @@
+#ifndef MEMORY_BUDGET_H_
+#define MEMORY_BUDGET_H_
+
+#include <cstdint>
+
+#include <gflags/gflags.h>
+
+// Defined in solver.cc, so that every solver accepts it.
+DECLARE_int64(memory_limit_mb);
+
+// Returns the memory available to this process in bytes. It is
+// --memory_limit_mb if given, otherwise the limit of the memory cgroup this
+// process belongs to, read again every few seconds. Returns 0 if unknown.
+int64_t GetMemoryLimit();
+
+// Adjusts a beam width so that the beam fits in the memory limit.
+// Width shrinks immediately but grows gradually, to avoid oscillation.
+class BeamWidthController {
+ public:
+  // Width starts at |initial_width| and moves in [1, max_width]. If
+  // |max_width| is 0, it is |initial_width|, so the width only shrinks. If
+  // the memory limit is unknown, it stays at |initial_width|.
+  BeamWidthController(int initial_width, int max_width);
+
+  int width() const { return width_; }
+  // The largest width fitting in the memory limit at the last Update(),
+  // regardless of the max width, or 0 if unknown.
+  int fitting_width() const { return fitting_width_; }
+
+  // Updates the width from the bytes needed per unit of width.
+  void Update(int64_t bytes_per_width);
+
+ private:
+  int width_;
+  int max_width_;
+  int fitting_width_;
+};
+
+#endif  // MEMORY_BUDGET_H_
@@ -0,0 +1,182 @@
+#include "progress_channel.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <glog/logging.h>
+
+DEFINE_string(progress_shm, "",
+              "If given, publish the best solution to this file through "
+              "shared memory while solving. With --all_seeds, the index of "
+              "the seed is appended as \".N\".");
+
+namespace {
+
+const char kMagic[8] = {'H', 'Z', 'K', 'P', 'R', 'O', 'G', '1'};
+const int64_t kInitialCapacity = 4096;
+const int kMaxReadAttempts = 100;
+
+}  // namespace
+
+ProgressWriter::ProgressWriter() : fd_(-1), map_(nullptr), map_size_(0) {}
+
+ProgressWriter::~ProgressWriter() {
+  if (map_) {
+    munmap(map_, map_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void ProgressWriter::Open(const std::string& path, int64_t problem_id,
+                          int64_t seed) {
+  CHECK(fd_ < 0) << "Already open";
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  PCHECK(fd_ >= 0) << path;
+  Reserve(kInitialCapacity);
+
+  // A reused file keeps its sequence, so that readers do not mistake the new
+  // game for an old snapshot.
+  ProgressHeader* h = header();
+  if (memcmp(h->magic, kMagic, sizeof(kMagic)) != 0) {
+    memcpy(h->magic, kMagic, sizeof(kMagic));
+  }
+  const uint64_t sequence = h->sequence.load(std::memory_order_relaxed) & ~1;
+  h->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  h->problem_id.store(problem_id, std::memory_order_relaxed);
+  h->seed.store(seed, std::memory_order_relaxed);
+  h->score.store(0, std::memory_order_relaxed);
+  h->commands_length.store(0, std::memory_order_relaxed);
+  h->capacity.store(map_size_ - sizeof(ProgressHeader),
+                    std::memory_order_relaxed);
+  h->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void ProgressWriter::Reserve(int64_t capacity) {
+  struct stat st;
+  PCHECK(fstat(fd_, &st) == 0);
+  size_t size = std::max<size_t>(st.st_size, sizeof(ProgressHeader));
+  if (size - sizeof(ProgressHeader) < static_cast<size_t>(capacity)) {
+    // Grow geometrically, so that a long game remaps only a few times.
+    size = sizeof(ProgressHeader) +
+        std::max<size_t>(capacity, 2 * (size - sizeof(ProgressHeader)));
+    PCHECK(ftruncate(fd_, size) == 0);
+  }
+  if (size == map_size_) {
+    return;
+  }
+  if (map_) {
+    munmap(map_, map_size_);
+  }
+  void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  PCHECK(map != MAP_FAILED);
+  map_ = static_cast<char*>(map);
+  map_size_ = size;
+}
+
+void ProgressWriter::Publish(int64_t score, const std::string& commands) {
+  ProgressHeader* h = header();
+  // Only this writer modifies the fields, so they are read without the lock.
+  const size_t length = h->commands_length.load(std::memory_order_relaxed);
+  char* buffer = map_ + sizeof(ProgressHeader);
+  const size_t keep = std::mismatch(
+      commands.begin(), commands.begin() + std::min(length, commands.size()),
+      buffer).first - commands.begin();
+  if (keep == length && keep == commands.size() &&
+      score == h->score.load(std::memory_order_relaxed)) {
+    return;
+  }
+  if (sizeof(ProgressHeader) + commands.size() > map_size_) {
+    Reserve(commands.size());
+    h = header();
+    buffer = map_ + sizeof(ProgressHeader);
+  }
+
+  const uint64_t sequence = h->sequence.load(std::memory_order_relaxed);
+  h->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(buffer + keep, commands.data() + keep, commands.size() - keep);
+  h->score.store(score, std::memory_order_relaxed);
+  h->commands_length.store(commands.size(), std::memory_order_relaxed);
+  h->capacity.store(map_size_ - sizeof(ProgressHeader),
+                    std::memory_order_relaxed);
+  h->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+ProgressReader::ProgressReader() : fd_(-1), map_(nullptr), map_size_(0) {}
+
+ProgressReader::~ProgressReader() {
+  if (map_) {
+    munmap(map_, map_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool ProgressReader::Open(const std::string& path) {
+  CHECK(fd_ < 0) << "Already open";
+  fd_ = open(path.c_str(), O_RDONLY);
+  return fd_ >= 0;
+}
+
+bool ProgressReader::Remap() {
+  struct stat st;
+  if (fstat(fd_, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(ProgressHeader)) {
+    return false;
+  }
+  if (map_) {
+    munmap(map_, map_size_);
+    map_ = nullptr;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  map_ = static_cast<char*>(map);
+  map_size_ = st.st_size;
+  return true;
+}
+
+bool ProgressReader::Read(int64_t* score, std::string* commands) {
+  if (fd_ < 0 || (!map_ && !Remap())) {
+    return false;
+  }
+  // A writer killed while publishing leaves the sequence odd for good, so
+  // give up after a while.
+  for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+    const ProgressHeader* h = reinterpret_cast<const ProgressHeader*>(map_);
+    const uint64_t sequence = h->sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+    const int64_t read_score = h->score.load(std::memory_order_relaxed);
+    const size_t length = h->commands_length.load(std::memory_order_relaxed);
+    if (sizeof(ProgressHeader) + length > map_size_) {
+      // The file grew for longer commands.
+      if (!Remap()) {
+        return false;
+      }
+      continue;
+    }
+    commands->assign(map_ + sizeof(ProgressHeader), length);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (h->sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+    *score = read_score;
+    return sequence != 0;
+  }
+  return false;
+}
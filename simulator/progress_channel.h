@@ -0,0 +1,81 @@
+#ifndef PROGRESS_CHANNEL_H_
+#define PROGRESS_CHANNEL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <gflags/gflags.h>
+
+#include "common.h"
+
+DECLARE_string(progress_shm);
+
+// Layout of a progress channel file. The commands of the best solution
+// follow the header. Fields are written under a seqlock: |sequence| is odd
+// while a write is in progress, so a reader retries if it saw an odd value
+// or the value changed during its read.
+struct ProgressHeader {
+  char magic[8];
+  std::atomic<uint64_t> sequence;
+  std::atomic<int64_t> problem_id;
+  std::atomic<int64_t> seed;
+  std::atomic<int64_t> score;
+  // Bytes of the commands after the header.
+  std::atomic<int64_t> commands_length;
+  // Bytes available for commands. The file grows when they do not fit.
+  std::atomic<int64_t> capacity;
+  int64_t reserved;
+};
+
+// Publishes the best solution of a game to a file mapped into memory, so that
+// other processes can read it without signals or pipes.
+class ProgressWriter {
+ public:
+  ProgressWriter();
+  ~ProgressWriter();
+
+  // Creates or reuses the file at |path| for the game of |seed|.
+  void Open(const std::string& path, int64_t problem_id, int64_t seed);
+  // Publishes a solution. Only the commands which changed since the last
+  // call are copied.
+  void Publish(int64_t score, const std::string& commands);
+
+ private:
+  // Makes room for |capacity| bytes of commands.
+  void Reserve(int64_t capacity);
+  ProgressHeader* header() const {
+    return reinterpret_cast<ProgressHeader*>(map_);
+  }
+
+  int fd_;
+  char* map_;
+  size_t map_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProgressWriter);
+};
+
+// Reads a file written by ProgressWriter.
+class ProgressReader {
+ public:
+  ProgressReader();
+  ~ProgressReader();
+
+  // Returns false if the file cannot be opened.
+  bool Open(const std::string& path);
+  // Reads a consistent snapshot. Returns false if nothing is published yet,
+  // or if no consistent snapshot could be read after some retries.
+  bool Read(int64_t* score, std::string* commands);
+
+ private:
+  // Maps the whole file. Returns false on failure.
+  bool Remap();
+
+  int fd_;
+  char* map_;
+  size_t map_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProgressReader);
+};
+
+#endif  // PROGRESS_CHANNEL_H_
@@ -0,0 +1,99 @@
+#include "progress_channel.h"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+class ProgressChannelTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    char path[] = "/tmp/progress_channel_test.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path_ = path;
+  }
+
+  virtual void TearDown() {
+    unlink(path_.c_str());
+  }
+
+  std::string path_;
+};
+
+}  // namespace
+
+TEST_F(ProgressChannelTest, ReadsPublishedSolutions) {
+  ProgressWriter writer;
+  writer.Open(path_, 6, 0);
+  ProgressReader reader;
+  ASSERT_TRUE(reader.Open(path_));
+
+  int64_t score = -1;
+  std::string commands = "x";
+  ASSERT_TRUE(reader.Read(&score, &commands));
+  EXPECT_EQ(0, score);
+  EXPECT_EQ("", commands);
+
+  writer.Publish(10, "palp");
+  ASSERT_TRUE(reader.Read(&score, &commands));
+  EXPECT_EQ(10, score);
+  EXPECT_EQ("palp", commands);
+
+  // A different line which shares a prefix, longer than the first mapping.
+  const std::string long_commands = "pa" + std::string(10000, 'k');
+  writer.Publish(20, long_commands);
+  ASSERT_TRUE(reader.Read(&score, &commands));
+  EXPECT_EQ(20, score);
+  EXPECT_EQ(long_commands, commands);
+
+  writer.Publish(5, "b");
+  ASSERT_TRUE(reader.Read(&score, &commands));
+  EXPECT_EQ(5, score);
+  EXPECT_EQ("b", commands);
+}
+
+TEST_F(ProgressChannelTest, ReusedFileStartsAGame) {
+  {
+    ProgressWriter writer;
+    writer.Open(path_, 6, 0);
+    writer.Publish(10, "palp");
+  }
+  ProgressWriter writer;
+  writer.Open(path_, 7, 1);
+  ProgressReader reader;
+  ASSERT_TRUE(reader.Open(path_));
+  int64_t score = -1;
+  std::string commands;
+  ASSERT_TRUE(reader.Read(&score, &commands));
+  EXPECT_EQ(0, score);
+  EXPECT_EQ("", commands);
+}
+
+TEST_F(ProgressChannelTest, GivesUpOnUnfinishedWrite) {
+  {
+    ProgressWriter writer;
+    writer.Open(path_, 6, 0);
+    writer.Publish(10, "palp");
+  }
+  // Leave the sequence odd, as a writer killed while publishing does.
+  FILE* file = fopen(path_.c_str(), "r+b");
+  ASSERT_TRUE(file != nullptr);
+  uint64_t sequence = 5;
+  ASSERT_EQ(0, fseek(file, offsetof(ProgressHeader, sequence), SEEK_SET));
+  ASSERT_EQ(1u, fwrite(&sequence, sizeof(sequence), 1, file));
+  fclose(file);
+
+  ProgressReader reader;
+  ASSERT_TRUE(reader.Open(path_));
+  int64_t score = -1;
+  std::string commands;
+  EXPECT_FALSE(reader.Read(&score, &commands));
+}
@@ -0,0 +1,215 @@
+#include "result_scanner.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+class Scanner {
+ public:
+  Scanner(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  bool AtEnd() {
+    SkipSpaces();
+    return p_ == end_;
+  }
+
+  // Consumes |c| after spaces.
+  bool Consume(char c) {
+    SkipSpaces();
+    if (p_ == end_ || *p_ != c) {
+      return false;
+    }
+    ++p_;
+    return true;
+  }
+
+  // Consumes a string and returns its escaped contents.
+  bool String(const char** data, size_t* length) {
+    if (!Consume('"')) {
+      return false;
+    }
+    const char* begin = p_;
+    while (p_ != end_ && *p_ != '"') {
+      if (*p_ == '\\' && ++p_ == end_) {
+        return false;
+      }
+      ++p_;
+    }
+    if (p_ == end_) {
+      return false;
+    }
+    *data = begin;
+    *length = p_++ - begin;
+    return true;
+  }
+
+  // Consumes an integer. Returns false if the value is not one.
+  bool Integer(int64_t* value) {
+    SkipSpaces();
+    const bool negative = p_ != end_ && *p_ == '-';
+    if (negative) {
+      ++p_;
+    }
+    if (p_ == end_ || !IsDigit(*p_)) {
+      return false;
+    }
+    int64_t v = 0;
+    while (p_ != end_ && IsDigit(*p_)) {
+      v = v * 10 + (*p_++ - '0');
+    }
+    if (p_ != end_ && (*p_ == '.' || *p_ == 'e' || *p_ == 'E')) {
+      return false;
+    }
+    *value = negative ? -v : v;
+    return true;
+  }
+
+  // Consumes any value.
+  bool Skip() {
+    SkipSpaces();
+    if (p_ == end_) {
+      return false;
+    }
+    if (*p_ == '"') {
+      const char* data;
+      size_t length;
+      return String(&data, &length);
+    }
+    if (*p_ == '{' || *p_ == '[') {
+      int depth = 0;
+      do {
+        if (*p_ == '"') {
+          const char* data;
+          size_t length;
+          if (!String(&data, &length)) {
+            return false;
+          }
+          continue;
+        }
+        if (*p_ == '{' || *p_ == '[') {
+          ++depth;
+        } else if (*p_ == '}' || *p_ == ']') {
+          --depth;
+        }
+        ++p_;
+      } while (depth > 0 && p_ != end_);
+      return depth == 0;
+    }
+    // A number, true, false or null.
+    const char* begin = p_;
+    while (p_ != end_ && strchr(",}] \t\r\n", *p_) == nullptr) {
+      ++p_;
+    }
+    return p_ != begin;
+  }
+
+ private:
+  static bool IsDigit(char c) {
+    return '0' <= c && c <= '9';
+  }
+
+  void SkipSpaces() {
+    while (p_ != end_ &&
+           (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n')) {
+      ++p_;
+    }
+  }
+
+  const char* p_;
+  const char* end_;
+};
+
+bool KeyIs(const char* key, size_t length, const char* name) {
+  return length == strlen(name) && memcmp(key, name, length) == 0;
+}
+
+void AppendUtf8(unsigned code, std::string* out) {
+  if (code < 0x80) {
+    *out += static_cast<char>(code);
+  } else if (code < 0x800) {
+    *out += static_cast<char>(0xc0 | (code >> 6));
+    *out += static_cast<char>(0x80 | (code & 0x3f));
+  } else {
+    *out += static_cast<char>(0xe0 | (code >> 12));
+    *out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    *out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+}
+
+}  // namespace
+
+bool ScanResult(const char* text, size_t length, ScannedResult* result) {
+  Scanner scanner(text, text + length);
+  if (!scanner.Consume('[') || !scanner.Consume('{')) {
+    return false;
+  }
+  bool has_score = false;
+  result->solution = nullptr;
+  result->solution_length = 0;
+  result->has_keep = false;
+  result->append = nullptr;
+  result->append_length = 0;
+  if (!scanner.Consume('}')) {
+    do {
+      const char* key;
+      size_t key_length;
+      if (!scanner.String(&key, &key_length) || !scanner.Consume(':')) {
+        return false;
+      }
+      bool ok;
+      if (KeyIs(key, key_length, "_score")) {
+        ok = has_score = scanner.Integer(&result->score);
+      } else if (KeyIs(key, key_length, "_keep")) {
+        ok = result->has_keep = scanner.Integer(&result->keep);
+      } else if (KeyIs(key, key_length, "solution")) {
+        ok = scanner.String(&result->solution, &result->solution_length) ||
+            scanner.Skip();
+      } else if (KeyIs(key, key_length, "_append")) {
+        ok = scanner.String(&result->append, &result->append_length) ||
+            scanner.Skip();
+      } else {
+        ok = scanner.Skip();
+      }
+      if (!ok) {
+        return false;
+      }
+    } while (scanner.Consume(','));
+    if (!scanner.Consume('}')) {
+      return false;
+    }
+  }
+  return scanner.Consume(']') && scanner.AtEnd() && has_score;
+}
+
+std::string UnescapeJsonString(const char* data, size_t length) {
+  const char* end = data + length;
+  const char* backslash =
+      static_cast<const char*>(memchr(data, '\\', length));
+  if (backslash == nullptr) {
+    return std::string(data, end);
+  }
+  std::string out(data, backslash);
+  for (const char* p = backslash; p < end; ++p) {
+    if (*p != '\\' || p + 1 == end) {
+      out += *p;
+      continue;
+    }
+    switch (*++p) {
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u':
+        if (end - p > 4) {
+          const std::string hex(p + 1, p + 5);
+          AppendUtf8(strtoul(hex.c_str(), nullptr, 16), &out);
+          p += 4;
+        }
+        break;
+      default: out += *p; break;
+    }
+  }
+  return out;
+}
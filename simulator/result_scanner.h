@@ -0,0 +1,35 @@
+#ifndef RESULT_SCANNER_H_
+#define RESULT_SCANNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Fields of a result line written by RunSolver2, like
+//   [{"_score":123,"tag":"...","solution":"..."}]
+// String fields point into the scanned text and are still escaped.
+struct ScannedResult {
+  int64_t score;
+  // "solution", or nullptr if it is not a string.
+  const char* solution;
+  size_t solution_length;
+  // "_keep" and "_append" of --incremental_output.
+  bool has_keep;
+  int64_t keep;
+  const char* append;
+  size_t append_length;
+};
+
+// Finds the fields above in |text| without building a JSON value, so that
+// reading the score of a line costs a single pass without copies. Returns
+// false if |text| is not a list of one object with an integer "_score".
+bool ScanResult(const char* text, size_t length, ScannedResult* result);
+
+inline bool ScanResult(const std::string& text, ScannedResult* result) {
+  return ScanResult(text.data(), text.size(), result);
+}
+
+// Decodes the escaped contents of a JSON string, as found by ScanResult.
+std::string UnescapeJsonString(const char* data, size_t length);
+
+#endif  // RESULT_SCANNER_H_
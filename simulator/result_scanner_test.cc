@@ -0,0 +1,50 @@
+#include "result_scanner.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::string Field(const char* data, size_t length) {
+  return data ? UnescapeJsonString(data, length) : "(null)";
+}
+
+}  // namespace
+
+TEST(ResultScannerTest, ScansResult) {
+  const std::string line =
+      "[{\"_score\":123,\"problemId\":6,\"seed\":0,\"tag\":\"a,b}\","
+      "\"_debug\":{\"x\":[1,\"]\"]},\"solution\":\"ia! ia!\\\\\\\"\"}]";
+  ScannedResult result;
+  ASSERT_TRUE(ScanResult(line, &result));
+  EXPECT_EQ(123, result.score);
+  EXPECT_EQ("ia! ia!\\\"",
+            Field(result.solution, result.solution_length));
+  EXPECT_FALSE(result.has_keep);
+  EXPECT_EQ(nullptr, result.append);
+}
+
+TEST(ResultScannerTest, ScansIncrementalResult) {
+  ScannedResult result;
+  ASSERT_TRUE(ScanResult(
+      " [ { \"_score\" : -5 , \"_keep\" : 42 , \"_append\" : \"\\u0041p\" } ] ",
+      &result));
+  EXPECT_EQ(-5, result.score);
+  EXPECT_EQ(nullptr, result.solution);
+  EXPECT_TRUE(result.has_keep);
+  EXPECT_EQ(42, result.keep);
+  EXPECT_EQ("Ap", Field(result.append, result.append_length));
+}
+
+TEST(ResultScannerTest, RejectsOtherLines) {
+  ScannedResult result;
+  EXPECT_FALSE(ScanResult("", &result));
+  EXPECT_FALSE(ScanResult("[]", &result));
+  EXPECT_FALSE(ScanResult("[{\"solution\":\"\"}]", &result));
+  EXPECT_FALSE(ScanResult("[{\"_score\":1.5}]", &result));
+  EXPECT_FALSE(ScanResult("[{\"_score\":\"1\"}]", &result));
+  EXPECT_FALSE(ScanResult("[{\"_score\":1},{\"_score\":2}]", &result));
+  EXPECT_FALSE(ScanResult("[{\"_score\":1,\"solution\":\"ab", &result));
+  EXPECT_FALSE(ScanResult("{\"_score\":1}", &result));
+}
@@ -1,8 +1,18 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include <csignal>
 
@@ -10,20 +20,59 @@
 #include <glog/logging.h>
 #include <picojson.h>
 
+#include "endgame.h"
 #include "game.h"
+#include "progress_channel.h"
 #include "solver.h"
+#include "thread_pool.h"
 
 DEFINE_string(ai_tag, "", "Tag of this trial");
 DEFINE_string(p, "", "comma-separated power phrases");
+DEFINE_double(deadline, 0,
+              "Seconds this solver may take from its start. "
+              "0 means no limit.");
+DEFINE_int64(memory_limit_mb, 0,
+             "Memory available to this solver in megabytes. "
+             "0 means the limit of its cgroup.");
+DEFINE_bool(all_seeds, false,
+            "Solve all seeds of the problem in this process and write one "
+            "result per seed, instead of only the first seed.");
+DEFINE_int32(seed_threads, 0,
+             "Seeds solved at the same time with --all_seeds. "
+             "0 means --threads.");
+DEFINE_bool(incremental_output, false,
+            "Results written on request carry only the change of the "
+            "commands since the last result of the game: the length of the "
+            "prefix to keep in \"_keep\" and the suffix in \"_append\". "
+            "The final result is always complete.");
+DEFINE_bool(worker, false,
+            "Keep reading problems from stdin, one JSON per line, and solve "
+            "them in turn. --deadline counts from the start of each.");
 
 namespace {
 
+// Start of the process, or of the current task with --worker.
+std::chrono::steady_clock::time_point g_start_time =
+    std::chrono::steady_clock::now();
+
+// When this thread solves one of several seeds, its share of --deadline.
+thread_local bool has_game_deadline_ = false;
+thread_local std::chrono::steady_clock::time_point game_deadline_;
+
+std::atomic<int> num_concurrent_games_(1);
+
+void WriteLine(const std::string& line) {
+  // Games of several seeds may finish at the same time.
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::cout << line << std::endl;
+}
+
 void WriteOneJsonResult(int problemid,
                         const std::string& tag,
                         int64_t seed,
                         int score,
                         const std::string& commands) {
-
   picojson::object output;
   output["solution"] = picojson::value(commands);
   output["problemId"] = picojson::value((int64_t)problemid);
@@ -35,16 +84,55 @@ void WriteOneJsonResult(int problemid,
   outputs.emplace_back(picojson::value(output));
 
   picojson::value finstr(outputs);
-  std::cout << finstr.serialize() << std::endl;
+  WriteLine(finstr.serialize());
+}
+
+// Writes the result of --incremental_output. The commands are the first
+// |keep| characters of the last result, followed by |append|.
+void WriteIncrementalJsonResult(int problemid,
+                                const std::string& tag,
+                                int64_t seed,
+                                int score,
+                                size_t keep,
+                                const std::string& append) {
+  picojson::object output;
+  output["problemId"] = picojson::value((int64_t)problemid);
+  output["seed"] = picojson::value((int64_t)seed);
+  output["tag"] = picojson::value(tag);
+  output["_score"] = picojson::value((int64_t)score);
+  output["_keep"] = picojson::value((int64_t)keep);
+  output["_append"] = picojson::value(append);
+
+  std::vector<picojson::value> outputs;
+  outputs.emplace_back(picojson::value(output));
+
+  picojson::value finstr(outputs);
+  WriteLine(finstr.serialize());
 }
 
 }  // namespace
 
+double GetRemainingSeconds() {
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  double remaining = std::numeric_limits<double>::infinity();
+  if (FLAGS_deadline > 0) {
+    std::chrono::duration<double> elapsed = now - g_start_time;
+    remaining = FLAGS_deadline - elapsed.count();
+  }
+  if (has_game_deadline_) {
+    std::chrono::duration<double> game_remaining = game_deadline_ - now;
+    remaining = std::min(remaining, game_remaining.count());
+  }
+  return remaining;
+}
+
 Solver::Solver() {}
 Solver::~Solver() {}
 
 Solver2::Solver2() {}
 Solver2::~Solver2() {}
+void Solver2::Finish() {}
 
 GameScorer::GameScorer() {}
 GameScorer::~GameScorer() {}
@@ -53,6 +141,9 @@ class Solver12Converter : public Solver2 {
 public:
   Solver12Converter(Solver* solver)
     : solver_(solver) {}
+  // Takes the ownership of |solver|.
+  explicit Solver12Converter(std::unique_ptr<Solver> solver)
+    : solver_(solver.get()), owned_solver_(std::move(solver)) {}
   ~Solver12Converter() {}
 
   virtual void AddGame(const Game& game) {
@@ -84,6 +175,7 @@ public:
   }
 private:
   Solver* solver_;
+  std::unique_ptr<Solver> owned_solver_;
   Game game_;
   std::string final_commands_;
 };
@@ -92,12 +184,17 @@ Solver2* ConvertS12(Solver* solver) {
   return new Solver12Converter(solver);
 }
 
+namespace {
+
 volatile sig_atomic_t sig_sig_ = 0;
+// Incremented on each SIGUSR1. Every running game dumps its result once per
+// increment.
+std::atomic<int> dump_requests_(0);
 
 void SigHandler(int num) {
   switch(num) {
   case SIGUSR1:
-    sig_sig_ = 1;
+    ++dump_requests_;
     break;
   case SIGINT:
     sig_sig_ =2;
@@ -107,61 +204,349 @@ void SigHandler(int num) {
   }
 }
 
-// TODO: make this a wrapper of RunSolver2.
-int RunSolver(Solver* solver, std::string solver_tag) {
-  Solver2 *s2 = ConvertS12(solver);
-  RunSolver2(s2, solver_tag);
-  delete s2;
-  return 0;
+void ReadProblem(picojson::value* problem, GameData* game_data) {
+  std::cin >> *problem;
+  CHECK(std::cin.good()) << picojson::get_last_error();
+  game_data->Load(*problem);
+  VLOG(1) << *game_data;
 }
 
-int RunSolver2(Solver2* solver, std::string solver_tag) {
-  if (!FLAGS_ai_tag.empty()) {
-    solver_tag = FLAGS_ai_tag;
+// Solves every seed on a thread pool, with a solver from |factory| each.
+void SolveAllSeeds(const std::function<Solver2*()>& factory,
+                   const GameData& game_data, const std::string& solver_tag,
+                   const std::atomic<bool>* interrupted) {
+  const int num_seeds = game_data.source_seeds().size();
+  const int num_threads = std::min(
+      num_seeds, FLAGS_seed_threads > 0 ? FLAGS_seed_threads : FLAGS_threads);
+  num_concurrent_games_ = num_threads;
+  std::atomic<int> num_started(0);
+  ThreadPool pool(num_threads);
+  pool.ParallelFor(num_seeds, [&](int i) {
+    if (sig_sig_ == 2 || (interrupted && *interrupted)) {
+      return;
+    }
+    // Seeds left, including this one, share the remaining time evenly.
+    const int rounds =
+        (num_seeds - num_started++ + num_threads - 1) / num_threads;
+    ScopedGameDeadline deadline(GetRemainingSeconds() / rounds);
+    std::unique_ptr<Solver2> solver(factory());
+    SolveGame(solver.get(), game_data, i, solver_tag, interrupted);
+  });
+  num_concurrent_games_ = 1;
+}
+
+// Reads the input of --worker on its own thread, so that control messages
+// reach the task being solved. Each line is either a problem, which is
+// queued as a task, or one of
+//   {"control": "dump"}: write the current results, like SIGUSR1.
+//   {"control": "interrupt", "task": i}: finish the i-th task (0-based) of
+//     the input now. Without "task", the task being solved.
+// The thread cannot be stopped while it waits for input, so a reader is
+// never destroyed.
+class TaskReader {
+ public:
+  // Returns a reader which lives until the process exits.
+  static TaskReader* New() {
+    return new TaskReader();
   }
+
+  // Waits for the next task. Returns false at the end of the input, or on
+  // SIGINT.
+  bool Next(picojson::value* task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // The signal handler cannot notify |cv_|, so look at it periodically.
+    while (!cv_.wait_for(lock, std::chrono::milliseconds(100),
+                         [this] { return !tasks_.empty() || eof_; })) {
+      if (sig_sig_ == 2) {
+        return false;
+      }
+    }
+    if (tasks_.empty()) {
+      return false;
+    }
+    *task = tasks_.front();
+    tasks_.pop_front();
+    ++current_;
+    interrupted_ = pending_interrupts_.erase(current_) > 0;
+    return true;
+  }
+
+  // Whether the current task is to be finished now.
+  const std::atomic<bool>* interrupted() const { return &interrupted_; }
+
+ private:
+  TaskReader() : num_read_(0), current_(-1), eof_(false), interrupted_(false) {
+    std::thread(&TaskReader::ReaderMain, this).detach();
+  }
+
+  void ReaderMain() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
+      }
+      // A bad line is skipped rather than aborting, which would lose the
+      // tasks queued behind it.
+      picojson::value value;
+      std::string error = picojson::parse(value, line);
+      if (!error.empty() || !value.is<picojson::object>()) {
+        LOG(ERROR) << "Skipping a malformed line: " << line << " " << error;
+        continue;
+      }
+      if (!value.contains("control")) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(value);
+        ++num_read_;
+        cv_.notify_all();
+        continue;
+      }
+      if (!value.get("control").is<std::string>() ||
+          (value.contains("task") && !value.get("task").is<int64_t>())) {
+        LOG(ERROR) << "Skipping a malformed control message: " << line;
+        continue;
+      }
+      const std::string& control = value.get("control").get<std::string>();
+      if (control == "dump") {
+        ++dump_requests_;
+      } else if (control == "interrupt") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int index = value.contains("task") ?
+            value.get("task").get<int64_t>() : current_;
+        if (index == current_) {
+          interrupted_ = true;
+        } else if (index > current_ && index < num_read_) {
+          pending_interrupts_.insert(index);
+        }
+      } else {
+        LOG(ERROR) << "Unknown control message: " << line;
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    eof_ = true;
+    cv_.notify_all();
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<picojson::value> tasks_;
+  int num_read_;
+  int current_;
+  std::set<int> pending_interrupts_;
+  bool eof_;
+  std::atomic<bool> interrupted_;
+
+  DISALLOW_COPY_AND_ASSIGN(TaskReader);
+};
+
+// Solves tasks from stdin until its end. After the results of each task,
+// writes an empty list to tell that the task is done.
+void RunWorker(const std::function<Solver2*()>& factory,
+               const std::string& solver_tag) {
+  SetSolverSignalHandlers();
+  // Leaked: on SIGINT this returns while the reader may still be blocked
+  // reading stdin.
+  TaskReader& reader = *TaskReader::New();
   picojson::value problem;
-  // Read problem from stdin.
-  {
-    std::cin >> problem;
-    CHECK(std::cin.good()) << picojson::get_last_error();
+  while (sig_sig_ != 2 && reader.Next(&problem)) {
+    g_start_time = std::chrono::steady_clock::now();
+    GameData game_data;
+    game_data.Load(problem);
+    VLOG(1) << game_data;
+    if (FLAGS_all_seeds) {
+      SolveAllSeeds(factory, game_data, solver_tag, reader.interrupted());
+    } else {
+      std::unique_ptr<Solver2> solver(factory());
+      SolveGame(solver.get(), game_data, 0, solver_tag, reader.interrupted());
+    }
+    WriteLine("[]");
   }
+}
 
-  // Always get the #0 seed.
-  const int64_t seed =
-    problem.get("sourceSeeds").get<picojson::array>()[0].get<int64_t>();
-  VLOG(1) << " Seed: " << seed;
-  GameData game_data;
-  game_data.Load(problem);
-  VLOG(1) << game_data;
+}  // namespace
 
+void SetSolverSignalHandlers() {
+  CHECK(std::signal(SIGUSR1, SigHandler) != SIG_ERR);
+  CHECK(std::signal(SIGINT, SigHandler) != SIG_ERR);
+}
+
+bool IsInterruptedBySignal() {
+  return sig_sig_ == 2;
+}
+
+int NumConcurrentGames() {
+  return num_concurrent_games_;
+}
+
+void SetNumConcurrentGames(int num_games) {
+  num_concurrent_games_ = num_games;
+}
+
+ScopedGameDeadline::ScopedGameDeadline(double seconds) {
+  has_game_deadline_ = !std::isinf(seconds);
+  if (has_game_deadline_) {
+    game_deadline_ = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(seconds));
+  }
+}
+
+ScopedGameDeadline::~ScopedGameDeadline() {
+  has_game_deadline_ = false;
+}
+
+namespace {
+
+std::map<std::string, RegisteredSolver>* GetSolverRegistry() {
+  static std::map<std::string, RegisteredSolver> registry;
+  return &registry;
+}
+
+}  // namespace
+
+bool RegisterSolver(const std::string& name, const std::string& tag,
+                    const std::function<Solver*()>& factory) {
+  return RegisterSolver2(name, tag, [factory]() -> Solver2* {
+      return new Solver12Converter(std::unique_ptr<Solver>(factory()));
+    });
+}
+
+bool RegisterSolver2(const std::string& name, const std::string& tag,
+                     const std::function<Solver2*()>& factory) {
+  RegisteredSolver& solver = (*GetSolverRegistry())[name];
+  CHECK(!solver.factory) << "Solver registered twice: " << name;
+  solver.tag = tag;
+  solver.factory = factory;
+  return true;
+}
+
+const RegisteredSolver* FindRegisteredSolver(const std::string& name) {
+  auto found = GetSolverRegistry()->find(name);
+  return found == GetSolverRegistry()->end() ? nullptr : &found->second;
+}
+
+std::vector<std::string> GetRegisteredSolverNames() {
+  std::vector<std::string> names;
+  for (const auto& entry : *GetSolverRegistry()) {
+    names.push_back(entry.first);
+  }
+  return names;
+}
+
+void SolveGame(Solver2* solver, const GameData& game_data, int seed_index,
+               const std::string& solver_tag,
+               const std::atomic<bool>* interrupted) {
+  std::unique_ptr<Solver2> endgame_tail;
+  if (FLAGS_endgame_units > 0) {
+    endgame_tail.reset(new EndgameTailSolver(solver));
+    solver = endgame_tail.get();
+  }
+  const int64_t seed = game_data.source_seeds()[seed_index];
+  VLOG(1) << " Seed: " << seed;
   {
     Game game;
-    game.Init(&game_data, 0);
+    game.Init(&game_data, seed_index);
     solver->AddGame(game);
   }
-  // Record signal handler
-  CHECK(std::signal(SIGUSR1, SigHandler) != SIG_ERR);
-  CHECK(std::signal(SIGINT, SigHandler) != SIG_ERR);
+  std::unique_ptr<ProgressWriter> progress;
+  if (!FLAGS_progress_shm.empty()) {
+    std::string path = FLAGS_progress_shm;
+    if (FLAGS_all_seeds) {
+      path += "." + std::to_string(seed_index);
+    }
+    progress.reset(new ProgressWriter());
+    progress->Open(path, game_data.id(), seed);
+  }
 
   std::string final_commands;
   int score;
+  int dumped_requests = dump_requests_;
+  // Commands of the last result written, for --incremental_output.
+  std::string reported_commands;
   while(true) {
     bool is_finished = solver->Next(&final_commands, &score);
+    if (progress) {
+      progress->Publish(score, final_commands);
+    }
     if(is_finished) {
       break;
     }
-    if (sig_sig_ == 2) {
+    if (sig_sig_ == 2 || (interrupted && *interrupted)) {
       VLOG(1) << "Shutting down:" << seed << ", " << score;
       break;
     }
-    if (sig_sig_ == 1) {
+    if (dumped_requests != dump_requests_) {
       VLOG(1) << "Dump Result:" << seed << ", " << score;
-      WriteOneJsonResult(problem.get("id").get<int64_t>(), solver_tag,
-                         seed, score, final_commands);
-      sig_sig_ = 0;
+      if (FLAGS_incremental_output) {
+        const size_t keep = std::mismatch(
+            reported_commands.begin(),
+            reported_commands.begin() +
+                std::min(reported_commands.size(), final_commands.size()),
+            final_commands.begin()).first - reported_commands.begin();
+        WriteIncrementalJsonResult(game_data.id(), solver_tag, seed, score,
+                                   keep, final_commands.substr(keep));
+        reported_commands = final_commands;
+      } else {
+        WriteOneJsonResult(game_data.id(), solver_tag,
+                           seed, score, final_commands);
+      }
+      dumped_requests = dump_requests_;
     }
   }
-  WriteOneJsonResult(problem.get("id").get<int64_t>(), solver_tag,
+  WriteOneJsonResult(game_data.id(), solver_tag,
                      seed, score, final_commands);
+  solver->Finish();
+}
+
+
+// TODO: make this a wrapper of RunSolver2.
+int RunSolver(Solver* solver, std::string solver_tag) {
+  Solver2 *s2 = ConvertS12(solver);
+  RunSolver2(s2, solver_tag);
+  delete s2;
+  return 0;
+}
+
+int RunSolver2(Solver2* solver, std::string solver_tag) {
+  CHECK(!FLAGS_all_seeds && !FLAGS_worker)
+      << "--all_seeds and --worker need a solver factory";
+  if (!FLAGS_ai_tag.empty()) {
+    solver_tag = FLAGS_ai_tag;
+  }
+  picojson::value problem;
+  GameData game_data;
+  ReadProblem(&problem, &game_data);
+  SetSolverSignalHandlers();
+  // Always get the #0 seed.
+  SolveGame(solver, game_data, 0, solver_tag, nullptr);
+  return 0;
+}
+
+int RunSolver(const std::function<Solver*()>& factory,
+              std::string solver_tag) {
+  return RunSolver2(
+      [&factory]() -> Solver2* {
+        return new Solver12Converter(std::unique_ptr<Solver>(factory()));
+      },
+      solver_tag);
+}
+
+int RunSolver2(const std::function<Solver2*()>& factory,
+               std::string solver_tag) {
+  if (!FLAGS_ai_tag.empty()) {
+    solver_tag = FLAGS_ai_tag;
+  }
+  if (FLAGS_worker) {
+    RunWorker(factory, solver_tag);
+    return 0;
+  }
+  if (!FLAGS_all_seeds) {
+    std::unique_ptr<Solver2> solver(factory());
+    return RunSolver2(solver.get(), solver_tag);
+  }
+  picojson::value problem;
+  GameData game_data;
+  ReadProblem(&problem, &game_data);
+  SetSolverSignalHandlers();
+  SolveAllSeeds(factory, game_data, solver_tag, nullptr);
   return 0;
 }
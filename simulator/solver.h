@@ -1,12 +1,19 @@
 #ifndef SOLVER_H__
 #define SOLVER_H__
 
+#include <atomic>
+#include <functional>
 #include <string>
 #include <vector>
 
+#include <gflags/gflags.h>
+
 #include "common.h"
 #include "game.h"
 
+DECLARE_double(deadline);
+DECLARE_bool(all_seeds);
+
 class Solver {
 public:
   Solver();
@@ -23,12 +30,78 @@ class Solver2 {
   // Returns is_finished and best_command, score.
   // TODO: should pass string** instead to avoid copy?
   virtual bool Next(std::string* best_command, int* score) = 0;
+  // Called when Next() will not be called any more, before the game is
+  // gone. Solvers running threads stop them here.
+  virtual void Finish();
 };
 
 Solver2* ConvertS12(Solver* solver);
 
 int RunSolver(Solver* solver, std::string solver_tag);
 int RunSolver2(Solver2* solver, std::string solver_tag);
+// With --all_seeds, solves every seed of the problem on a thread pool, each
+// with a new solver from |factory|, and writes a result line as each seed
+// finishes. The problem is parsed once for all of them.
+// Without it, solves the first seed like the functions above.
+// With --worker, solves problems from stdin one after another.
+int RunSolver(const std::function<Solver*()>& factory,
+              std::string solver_tag);
+int RunSolver2(const std::function<Solver2*()>& factory,
+               std::string solver_tag);
+
+// Solves the |seed_index|-th seed of |game_data| and writes the result
+// like RunSolver2. Stops early on SIGINT or when |interrupted| is set, if
+// it is not null. Several games may be solved on different threads.
+void SolveGame(Solver2* solver, const GameData& game_data, int seed_index,
+               const std::string& solver_tag,
+               const std::atomic<bool>* interrupted);
+
+// Makes SIGUSR1 write the results of the games being solved, and SIGINT
+// stop them.
+void SetSolverSignalHandlers();
+// Whether SIGINT came.
+bool IsInterruptedBySignal();
+
+// Returns seconds left until --deadline, or infinity if it is not given.
+// With --all_seeds, the deadline is for the game solved on this thread.
+double GetRemainingSeconds();
+
+// Limits GetRemainingSeconds() on this thread to |seconds| from now, while
+// it is alive.
+class ScopedGameDeadline {
+ public:
+  explicit ScopedGameDeadline(double seconds);
+  ~ScopedGameDeadline();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedGameDeadline);
+};
+
+// Number of games solved at the same time in this process. Budgets of the
+// process, like memory, are shared by them.
+int NumConcurrentGames();
+void SetNumConcurrentGames(int num_games);
+
+// Solvers linked into a binary, by name, so that ai/host can run any of
+// them. Each solver registers itself with REGISTER_SOLVER.
+struct RegisteredSolver {
+  std::string tag;
+  std::function<Solver2*()> factory;
+};
+bool RegisterSolver(const std::string& name, const std::string& tag,
+                    const std::function<Solver*()>& factory);
+bool RegisterSolver2(const std::string& name, const std::string& tag,
+                     const std::function<Solver2*()>& factory);
+// Returns the solver registered as |name|, or nullptr.
+const RegisteredSolver* FindRegisteredSolver(const std::string& name);
+std::vector<std::string> GetRegisteredSolverNames();
+
+#define REGISTER_SOLVER(name, tag, factory) \
+  static const bool solver_##name##_registered = \
+      RegisterSolver(#name, tag, factory)
+#define REGISTER_SOLVER2(name, tag, factory) \
+  static const bool solver_##name##_registered = \
+      RegisterSolver2(#name, tag, factory)
 
 class GameScorer {
  public:
@@ -0,0 +1,99 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+DEFINE_int32(threads, 1, "Number of threads used for search.");
+
+namespace {
+
+// Shared by the caller of ParallelFor and its helper tasks. Helpers may start
+// after the loop is already done, so this outlives the caller's frame.
+struct ParallelForState {
+  ParallelForState(int n, const std::function<void(int)>& func)
+    : n(n), func(func), next(0), done(0) {}
+
+  // Runs indices until none is left.
+  void Run() {
+    for (int i = next++; i < n; i = next++) {
+      func(i);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (++done == n) {
+        cv.notify_all();
+      }
+    }
+  }
+
+  const int n;
+  const std::function<void(int)> func;
+  std::atomic<int> next;
+  std::mutex mutex;
+  std::condition_variable cv;
+  int done;
+};
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads) : shutdown_(false) {
+  for (int i = 1; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerMain, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Submit(const std::function<void()>& task) {
+  if (workers_.empty()) {
+    task();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(task);
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::ParallelFor(int n, const std::function<void(int)>& func) {
+  int num_helpers = std::min<int>(workers_.size(), n - 1);
+  if (num_helpers <= 0) {
+    for (int i = 0; i < n; ++i) {
+      func(i);
+    }
+    return;
+  }
+
+  std::shared_ptr<ParallelForState> state(new ParallelForState(n, func));
+  for (int i = 0; i < num_helpers; ++i) {
+    Submit([state]() { state->Run(); });
+  }
+  state->Run();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&state]() { return state->done == state->n; });
+}
+
+void ThreadPool::WorkerMain() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return shutdown_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "common.h"
+
+DECLARE_int32(threads);
+
+// Fixed size pool of worker threads.
+// A pool created with one thread has no workers, and everything runs on the
+// calling thread.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  int num_threads() const { return workers_.size() + 1; }
+
+  // Runs the task on a worker thread.
+  void Submit(const std::function<void()>& task);
+
+  // Runs func(i) for each i in [0, n) and waits for all of them. The calling
+  // thread also takes indices, so this can be used from inside a task.
+  // Indices are handed out dynamically, so callers must not depend on which
+  // thread runs which index; write results into per-index slots instead.
+  void ParallelFor(int n, const std::function<void(int)>& func);
+
+ private:
+  void WorkerMain();
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()> > tasks_;
+  bool shutdown_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+#endif  // THREAD_POOL_H_
@@ -1,129 +1,321 @@
+// Runs solvers for a task and reports only the best of their results, so
+// that the supervisor reads one line per request instead of every result.
+//
+//   hazuki_proxy solver1 [args...] [-- solver2 [args...] ...] < task.json
+//
+// SIGUSR1 is forwarded to the solvers; the best result is printed when one
+// of them improves it in reply. SIGINT is forwarded too, and the best result
+// is printed once every solver has exited or closed its output.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <picojson.h>
 
-static volatile sig_atomic_t g_signaled = 0;
-
-void OnSignal(int signum) {
-  if (signum == SIGUSR1) {
-    g_signaled = 1;
-  } else if (signum == SIGINT) {
-    g_signaled = 2;
-  }
-}
+#include "../simulator/result_scanner.h"
 
-void InstallSignalHandler() {
-  struct sigaction sa;
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_handler = OnSignal;
-  sigaction(SIGUSR1, &sa, NULL);
-  sigaction(SIGINT, &sa, NULL);
+// Signals handled through a signalfd. SIGCHLD is only needed where
+// pidfd_open() is not available.
+void BlockSignals(sigset_t* mask, sigset_t* old_mask) {
+  sigemptyset(mask);
+  sigaddset(mask, SIGUSR1);
+  sigaddset(mask, SIGINT);
+  sigaddset(mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, mask, old_mask);
 }
 
-void CreateAiProcess(int argc, char** argv, pid_t* pid, int* fd) {
+// Starts a solver which reads |input| from its stdin, and returns its
+// stdout in |fd|.
+void CreateAiProcess(char** argv, const std::string& input,
+                     const sigset_t& old_mask, pid_t* pid, int* fd) {
   int pipefd[2];
-  pipe(pipefd);
+  // Other solvers must not inherit the pipe, or it never reaches EOF.
+  pipe2(pipefd, O_CLOEXEC);
   *pid = fork();
   if (*pid != 0) {
     close(pipefd[1]);
     *fd = pipefd[0];
+    fcntl(*fd, F_SETFL, fcntl(*fd, F_GETFL) | O_NONBLOCK);
     return;
   }
+  // The blocked signals are inherited through exec.
+  sigprocmask(SIG_SETMASK, &old_mask, NULL);
+  // Each solver reads the task from its own file, since sharing the stdin
+  // of the proxy would share its offset.
+  FILE* input_file = tmpfile();
+  fwrite(input.data(), 1, input.size(), input_file);
+  fflush(input_file);
+  rewind(input_file);
+  dup2(fileno(input_file), 0);
+  fclose(input_file);
   dup2(pipefd[1], 1);
-  close(pipefd[0]);
   close(pipefd[1]);
   execvp(argv[0], argv);
   exit(28);
 }
 
-int GetSolutionScore(const std::string& json_text) {
-  std::istringstream json_in(json_text);
-  picojson::value solutions_value;
-  if (!(json_in >> solutions_value)) {
-    return -1;
-  }
-  if (!solutions_value.is<picojson::array>()) {
-    return -1;
+// Returns a file descriptor which becomes readable when |pid| exits, or -1
+// if the kernel does not support it.
+int OpenPidFd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return syscall(SYS_pidfd_open, pid, 0);
+#else
+  return -1;
+#endif
+}
+
+// Splits the output of the solver into lines. Lines are found in place, and
+// the consumed bytes are dropped by moving the rest to the front only when
+// the free space runs out, so each byte is copied O(1) times on average.
+class LineBuffer {
+ public:
+  LineBuffer() : buffer_(4096), begin_(0), end_(0), scanned_(0) {}
+
+  // Reads what is available from |fd|. Returns false on EOF or an error.
+  bool ReadFrom(int fd) {
+    for (;;) {
+      if (end_ == buffer_.size()) {
+        MakeRoom();
+      }
+      ssize_t read_size =
+          read(fd, buffer_.data() + end_, buffer_.size() - end_);
+      if (read_size > 0) {
+        end_ += read_size;
+        continue;
+      }
+      if (read_size < 0 && errno == EINTR) {
+        continue;
+      }
+      return read_size < 0 && errno == EAGAIN;
+    }
   }
-  const picojson::array& solutions = solutions_value.get<picojson::array>();
-  if (solutions.size() != 1) {
-    return -1;
+
+  // Stores the next complete line without the newline into |line| and
+  // returns true, or returns false if there is none.
+  bool NextLine(std::string* line) {
+    const char* newline = static_cast<const char*>(
+        memchr(buffer_.data() + scanned_, '\n', end_ - scanned_));
+    if (newline == NULL) {
+      scanned_ = end_;
+      return false;
+    }
+    const size_t pos = newline - buffer_.data();
+    line->assign(buffer_.data() + begin_, pos - begin_);
+    begin_ = scanned_ = pos + 1;
+    return true;
   }
-  const picojson::value& solution_value = solutions[0];
-  if (!solution_value.is<picojson::object>()) {
-    return -1;
+
+ private:
+  void MakeRoom() {
+    if (begin_ > 0) {
+      std::copy(buffer_.begin() + begin_, buffer_.begin() + end_,
+                buffer_.begin());
+      end_ -= begin_;
+      scanned_ -= begin_;
+      begin_ = 0;
+    }
+    if (end_ * 2 > buffer_.size()) {
+      buffer_.resize(buffer_.size() * 2);
+    }
   }
-  const picojson::object& solution = solution_value.get<picojson::object>();
-  if (solution.count("_score") == 0) {
-    return -1;
+
+  std::vector<char> buffer_;
+  // Bytes in [begin_, end_) are not consumed yet. Bytes in [begin_, scanned_)
+  // are known to have no newline.
+  size_t begin_;
+  size_t end_;
+  size_t scanned_;
+};
+
+// Updates |commands| by a result of --incremental_output, which only has
+// the change from the last solution. |full_result| is the last result with
+// a whole solution, if it is not taken into |commands| yet.
+void ApplyIncrementalResult(const ScannedResult& result,
+                            std::string* full_result, std::string* commands) {
+  ScannedResult full;
+  if (!full_result->empty() && ScanResult(*full_result, &full) &&
+      full.solution) {
+    *commands = UnescapeJsonString(full.solution, full.solution_length);
   }
-  const picojson::value& score_value = solution.find("_score")->second;
-  if (!score_value.is<int64_t>()) {
-    return -1;
+  full_result->clear();
+  commands->resize(std::min<size_t>(result.keep, commands->size()));
+  if (result.append) {
+    *commands += UnescapeJsonString(result.append, result.append_length);
   }
-  return static_cast<int>(score_value.get<int64_t>());
 }
 
-int main(int argc, char** argv) {
-  InstallSignalHandler();
+// Returns |json_text| of an incremental result with its full solution
+// |commands| in place of the change.
+std::string FillSolution(const std::string& json_text,
+                         const std::string& commands) {
+  picojson::value solutions;
+  std::istringstream json_in(json_text);
+  json_in >> solutions;
+  picojson::object& solution =
+      solutions.get<picojson::array>()[0].get<picojson::object>();
+  solution.erase("_keep");
+  solution.erase("_append");
+  solution["solution"] = picojson::value(commands);
+  return solutions.serialize();
+}
 
+// A solver run by the proxy.
+struct Child {
   pid_t pid;
+  // Becomes readable when the solver exits, or -1 without pidfd support.
+  int pid_fd;
+  // The stdout of the solver.
   int fd;
-  CreateAiProcess(argc - 1, argv + 1, &pid, &fd);
+  LineBuffer lines;
+  // The last solution of the solver, and the result it is to be updated to.
+  std::string commands;
+  std::string full_result;
+  // Whether the next result of the solver answers SIGUSR1.
+  bool print_next;
+  bool exited;
+  bool output_open;
+};
 
-  int returncode = 0;
-  std::string best_json_text = "[{\"_score\":0,\"tag\":\"sentinel\",\"solution\":\"\"}]";
-  int best_score = 0;
-  std::string json_buf;
-  bool print_next = false;
-
-  for (;;) {
-    if (g_signaled == 1) {
-      kill(pid, SIGUSR1);
-      g_signaled = 0;
-      print_next = true;
-    }
-    if (g_signaled == 2) {
-      kill(pid, SIGKILL);
-      while (waitpid(pid, NULL, 0) != 0 && errno == EINTR);
-      returncode = 28;
-      break;
+int main(int argc, char** argv) {
+  sigset_t mask, old_mask;
+  BlockSignals(&mask, &old_mask);
+  const int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  const std::string input((std::istreambuf_iterator<char>(std::cin)),
+                          std::istreambuf_iterator<char>());
+
+  // Solver commands are separated by "--".
+  std::vector<Child> children;
+  for (int begin = 1, end; begin < argc; begin = end + 1) {
+    for (end = begin; end < argc && strcmp(argv[end], "--") != 0; ++end) {}
+    if (end == begin) {
+      continue;
     }
+    argv[end < argc ? end : argc] = NULL;
+    children.emplace_back();
+    Child& child = children.back();
+    CreateAiProcess(argv + begin, input, old_mask, &child.pid, &child.fd);
+    child.pid_fd = OpenPidFd(child.pid);
+    child.print_next = false;
+    child.exited = false;
+    child.output_open = true;
+  }
+
+  std::string best_json_text = "[{\"_score\":0,\"tag\":\"sentinel\",\"solution\":\"\"}]";
+  int64_t best_score = 0;
+  std::string json_text;
+  bool interrupted = false;
+  size_t num_running = children.size();
+  std::vector<struct pollfd> fds(1 + 2 * children.size());
 
-    int status;
-    if (waitpid(pid, &status, WNOHANG) > 0) {
-      returncode = WEXITSTATUS(status);
+  // Blocks until a solver writes, exits or a signal comes, so that the
+  // proxy uses no CPU while the solvers are thinking.
+  while (num_running > 0) {
+    // poll() ignores negative descriptors, so SIGCHLD tells the exit when
+    // there is no pidfd.
+    fds[0] = {signal_fd, POLLIN, 0};
+    for (size_t i = 0; i < children.size(); ++i) {
+      const Child& child = children[i];
+      fds[1 + 2 * i] = {child.exited ? -1 : child.pid_fd, POLLIN, 0};
+      fds[2 + 2 * i] = {child.output_open ? child.fd : -1, POLLIN, 0};
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
       break;
     }
 
-    char tmp_buf[4096];
-    int read_size = read(fd, tmp_buf, sizeof(tmp_buf));
-    if (read_size > 0) {
-      json_buf += std::string(tmp_buf, read_size);
+    bool child_changed = false;
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+      if (info.ssi_signo == SIGUSR1) {
+        for (Child& child : children) {
+          if (!child.exited) {
+            kill(child.pid, SIGUSR1);
+            child.print_next = true;
+          }
+        }
+      } else if (info.ssi_signo == SIGINT && !interrupted) {
+        for (Child& child : children) {
+          if (!child.exited) {
+            kill(child.pid, SIGINT);
+          }
+        }
+        interrupted = true;
+      } else if (info.ssi_signo == SIGCHLD) {
+        child_changed = true;
+      }
     }
+    for (size_t i = 0; i < children.size(); ++i) {
+      Child& child = children[i];
+      if (!child.exited && (child_changed || fds[1 + 2 * i].revents) &&
+          waitpid(child.pid, NULL, WNOHANG) > 0) {
+        child.exited = true;
+        --num_running;
+      }
+      // After the exit, take the rest of the output without waiting for EOF,
+      // which never comes if the solver left processes holding the pipe.
+      if (child.output_open && (child.exited || fds[2 + 2 * i].revents)) {
+        child.output_open = child.lines.ReadFrom(child.fd);
+      }
 
-    std::string::size_type pos;
-    while ((pos = json_buf.find("\n")) != std::string::npos) {
-      std::string json_text = json_buf.substr(0, pos);
-      json_buf = json_buf.substr(pos + 1);
-      int score = GetSolutionScore(json_text);
-      if (score > best_score) {
-        best_score = score;
-        best_json_text = json_text;
-        if (print_next) {
-          std::cout << best_json_text << std::endl;
+      while (child.lines.NextLine(&json_text)) {
+        // Only the score is read from a line, and it is kept as is if it is
+        // the new best; most lines are neither parsed nor copied.
+        ScannedResult result;
+        if (ScanResult(json_text, &result)) {
+          if (result.has_keep) {
+            ApplyIncrementalResult(result, &child.full_result,
+                                   &child.commands);
+          }
+          if (result.score > best_score) {
+            best_score = result.score;
+            best_json_text = result.has_keep ?
+                FillSolution(json_text, child.commands) : json_text;
+            if (child.print_next) {
+              std::cout << best_json_text << std::endl;
+            }
+          }
+          if (!result.has_keep && result.solution) {
+            child.full_result.swap(json_text);
+          }
         }
+        child.print_next = false;
       }
-      print_next = false;
+    }
+
+    // Once interrupted, a solver which closed its output has nothing more
+    // to tell, even if it has not exited yet.
+    if (interrupted &&
+        std::none_of(children.begin(), children.end(),
+                     [](const Child& child) {
+                       return !child.exited && child.output_open;
+                     })) {
+      break;
+    }
+  }
+
+  for (Child& child : children) {
+    if (!child.exited) {
+      kill(child.pid, SIGKILL);
+      while (waitpid(child.pid, NULL, 0) < 0 && errno == EINTR);
     }
   }
 
@@ -0,0 +1,81 @@
+"""Predicts how long solvers take on a task, from benchmarks.
+
+tools/build_runtime_model.py runs solvers over problems and writes a model
+file, which maps the basename of each solver to coefficients of
+
+  log(seconds per unit) = c0 + c1 log(width) + c2 log(height)
+                          + c3 log(number of unit shapes)
+
+A game plays at most sourceLength units, so the time of a task is
+predicted as the time per unit times sourceLength.
+"""
+
+import math
+import os
+
+import ujson as json
+
+
+def task_features(task):
+  return [
+    1.0,
+    math.log(task['width']),
+    math.log(task['height']),
+    math.log(len(task['units'])),
+  ]
+
+
+def fit(samples, ridge=1e-3):
+  """Returns the coefficients fitted to samples by least squares.
+
+  Each sample is a (task features, seconds per unit) pair. A little ridge
+  keeps the fit stable with only a few problems.
+  """
+  n = len(samples[0][0])
+  a = [[0.0] * n for _ in xrange(n)]
+  b = [0.0] * n
+  for features, seconds_per_unit in samples:
+    y = math.log(max(seconds_per_unit, 1e-9))
+    for i in xrange(n):
+      b[i] += features[i] * y
+      for j in xrange(n):
+        a[i][j] += features[i] * features[j]
+  for i in xrange(1, n):
+    a[i][i] += ridge
+  # Gaussian elimination with partial pivoting.
+  for col in xrange(n):
+    pivot = max(xrange(col, n), key=lambda row: abs(a[row][col]))
+    a[col], a[pivot] = a[pivot], a[col]
+    b[col], b[pivot] = b[pivot], b[col]
+    for row in xrange(col + 1, n):
+      ratio = a[row][col] / a[col][col]
+      for j in xrange(col, n):
+        a[row][j] -= ratio * a[col][j]
+      b[row] -= ratio * b[col]
+  coefficients = [0.0] * n
+  for row in reversed(xrange(n)):
+    coefficients[row] = (b[row] - sum(
+      a[row][j] * coefficients[j] for j in xrange(row + 1, n))) / a[row][row]
+  return coefficients
+
+
+class RuntimeModel(object):
+  def __init__(self, models):
+    self._models = models
+
+  @classmethod
+  def load(cls, path):
+    with open(path) as f:
+      return cls(json.load(f))
+
+  def predict(self, solver_path, task):
+    """Returns the predicted seconds of the solver on the task.
+
+    Returns None if the solver is not in the model.
+    """
+    model = self._models.get(os.path.basename(solver_path))
+    if not model:
+      return None
+    log_seconds_per_unit = sum(
+      c * x for c, x in zip(model['coefficients'], task_features(task)))
+    return math.exp(log_seconds_per_unit) * task['sourceLength']
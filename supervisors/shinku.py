@@ -18,6 +18,7 @@ import threading
 
 import logging_util
 import gflags
+import runtime_model
 import supervisor_util
 import ujson as json
 
@@ -36,6 +37,17 @@ gflags.DEFINE_multistring('quick_solver', [], 'Path to quick solver.')
 gflags.DEFINE_multistring('heavy_solver', [], 'Path to heavy solver.')
 gflags.DEFINE_multistring('extra_solver', [], 'Path to extra solver.')
 gflags.DEFINE_string('rewriter', None, 'Path to rewriter.')
+gflags.DEFINE_string(
+  'runtime_model', None,
+  'Path to a model written by tools/build_runtime_model.py. Heavy solvers '
+  'predicted not to finish before the solver deadline are not started.')
+gflags.DEFINE_float(
+  'runtime_model_margin', 1.0,
+  'Heavy solvers are started if their predicted time times this fits.')
+gflags.DEFINE_bool(
+  'enable_pipelined_rewriting', False,
+  'Rewrite solver results during the solver phase, as soon as a solver '
+  'finishes or its score stops improving.')
 gflags.DEFINE_bool('show_scores', False, 'Show scores.')
 gflags.DEFINE_bool('report', True, 'Report the result to log server.')
 gflags.DEFINE_string('report_tag', None, 'Overrides tag on reporting.')
@@ -75,8 +87,10 @@ def register_reschedule_callbacks(secondary_job, primary_jobs):
     heavy_jobs = [job for job in primary_jobs if job.data != 'quick']
     quick_jobs.sort(key=lambda job: job.solution['_score'], reverse=True)
     heavy_jobs.sort(key=lambda job: job.solution['_score'], reverse=True)
-    quick_score = quick_jobs[0].solution['_score']
-    heavy_score = heavy_jobs[0].solution['_score']
+    # Heavy jobs of the primary task may have been skipped by the runtime
+    # model.
+    quick_score = quick_jobs[0].solution['_score'] if quick_jobs else 0
+    heavy_score = heavy_jobs[0].solution['_score'] if heavy_jobs else 0
     if heavy_score <= quick_score:
       base_priority = 700
     else:
@@ -92,9 +106,115 @@ def register_reschedule_callbacks(secondary_job, primary_jobs):
     job.register_finish_callback(finish_callback)
 
 
-def run_solvers(tasks, num_threads, deadline):
+def make_admission_check(deadline):
+  """Returns a function telling whether a heavy job can finish before the
+  deadline, by the runtime model. It is an admission_check of
+  run_generic_jobs, so the time left is taken when the job is about to
+  start."""
+  if not FLAGS.runtime_model:
+    return None
+  model = runtime_model.RuntimeModel.load(FLAGS.runtime_model)
+
+  def can_finish(job):
+    if job.data != 'heavy':
+      return True
+    solver = job.args[0]
+    seconds = model.predict(solver, job.task)
+    time_available = deadline - time.time()
+    if (seconds is None or
+        seconds * FLAGS.runtime_model_margin <= time_available):
+      return True
+    logging.info(
+      'Skipping %s on p%d/s%d: predicted %.1fs, available %.1fs',
+      os.path.basename(solver), job.problem_id, job.seed, seconds,
+      time_available)
+    return False
+
+  return can_finish
+
+
+def make_rewriter_args():
+  return [FLAGS.rewriter, '-p', ','.join(FLAGS.powerphrase)]
+
+
+class RewritePipeline(object):
+  """Hands results of solver jobs to rewriter jobs during the solver phase.
+
+  A result is handed over when its solver finishes, or when its score has
+  not improved for --adaptive_window seconds, if it beats every result
+  handed over for the same task. This is a job_source of run_generic_jobs.
+  """
+
+  PRIORITY = 150
+
+  def __init__(self, tasks):
+    self.rewriter_jobs = []
+    self._task_map = dict(
+      ((task['id'], task['sourceSeeds'][0]), task) for task in tasks)
+    self._solver_jobs = []
+    self._finished_jobs = []
+    self._handed_scores = collections.defaultdict(lambda: 0)
+    self._rewritten_scores = collections.defaultdict(lambda: 0)
+    self._lock = threading.Lock()
+
+  def watch(self, job):
+    self._solver_jobs.append(job)
+    job.register_finish_callback(self._on_solver_finish)
+
+  def _on_solver_finish(self, job):
+    with self._lock:
+      self._finished_jobs.append(job)
+
+  def __call__(self):
+    with self._lock:
+      finished_jobs = self._finished_jobs
+      self._finished_jobs = []
+    candidates = [job.solution for job in finished_jobs]
+    for job in self._solver_jobs:
+      if job.start_time and not job.end_time:
+        rate = job.improvement_rate(FLAGS.adaptive_window)
+        if rate is not None and rate <= 0:
+          candidates.append(job.solution)
+    new_jobs = []
+    for solution in candidates:
+      key = (solution['problemId'], solution['seed'])
+      if solution['_score'] <= self._handed_scores[key]:
+        continue
+      self._handed_scores[key] = solution['_score']
+      job = supervisor_util.RewriterJob(
+        args=make_rewriter_args(),
+        solution=solution,
+        priority=self.PRIORITY,
+        task=self._task_map[key],
+        cgroup=None if FLAGS.disable_cgroup else CGROUP_NAME)
+      job.register_finish_callback(self._on_rewriter_finish)
+      self.rewriter_jobs.append(job)
+      new_jobs.append(job)
+    return new_jobs
+
+  def _on_rewriter_finish(self, job):
+    # An interrupted rewriter reports nothing, and its input is left to the
+    # rewriter phase.
+    if job.solution['_score'] > 0:
+      key = (job.problem_id, job.seed)
+      with self._lock:
+        self._rewritten_scores[key] = max(
+          self._rewritten_scores[key], job.original_solution['_score'])
+
+  def is_rewritten(self, solution):
+    """Whether a result at least as good was rewritten already."""
+    with self._lock:
+      return solution['_score'] <= self._rewritten_scores[
+        (solution['problemId'], solution['seed'])]
+
+
+def run_solvers(tasks, num_threads, deadline, pipeline=None):
   jobs = []
 
+  # Solvers share the cgroup, so each of them gets an even share of it.
+  memlimit_args = [
+    '--memory_limit_mb=%d' % max(1, (FLAGS.memlimit - 128) / num_threads)]
+
   primary_tasks = []
   secondary_tasks = []
   primary_task_map = {}
@@ -106,10 +226,13 @@ def run_solvers(tasks, num_threads, deadline):
       secondary_tasks.append(task)
 
   primary_jobs_map = collections.defaultdict(list)
-  for quick_solver in FLAGS.quick_solver:
+  quick_job_class = supervisor_util.SolverJob
+  if FLAGS.enable_solver_workers:
+    quick_job_class = supervisor_util.SolverWorkerJob
+  if FLAGS.enable_fan_in_proxy and FLAGS.quick_solver:
     for task in tasks:
-      job = supervisor_util.SolverJob(
-        args=[quick_solver],
+      job = supervisor_util.FanInSolverJob(
+        args_list=[[quick_solver] for quick_solver in FLAGS.quick_solver],
         task=task,
         priority=100,
         data='quick',
@@ -117,11 +240,23 @@ def run_solvers(tasks, num_threads, deadline):
       jobs.append(job)
       if task is primary_task_map[job.problem_id]:
         primary_jobs_map[job.problem_id].append(job)
+  else:
+    for quick_solver in FLAGS.quick_solver:
+      for task in tasks:
+        job = quick_job_class(
+          args=[quick_solver],
+          task=task,
+          priority=100,
+          data='quick',
+          cgroup=None if FLAGS.disable_cgroup else CGROUP_NAME)
+        jobs.append(job)
+        if task is primary_task_map[job.problem_id]:
+          primary_jobs_map[job.problem_id].append(job)
 
   for heavy_solver in FLAGS.heavy_solver:
     for task in primary_tasks:
       job = supervisor_util.SolverJob(
-        args=[heavy_solver],
+        args=[heavy_solver] + memlimit_args,
         task=task,
         priority=200,
         data='heavy',
@@ -132,7 +267,7 @@ def run_solvers(tasks, num_threads, deadline):
   for heavy_solver in FLAGS.heavy_solver:
     for task in secondary_tasks:
       job = supervisor_util.SolverJob(
-        args=[heavy_solver],
+        args=[heavy_solver] + memlimit_args,
         task=task,
         priority=500,
         data='heavy',
@@ -140,15 +275,30 @@ def run_solvers(tasks, num_threads, deadline):
       jobs.append(job)
       register_reschedule_callbacks(job, primary_jobs_map[job.problem_id])
 
-  for extra_solver in FLAGS.extra_solver:
+  if FLAGS.enable_fan_in_proxy and FLAGS.extra_solver:
     for task in tasks:
-      job = supervisor_util.SolverJob(
-        args=[extra_solver],
+      job = supervisor_util.FanInSolverJob(
+        args_list=[[extra_solver] + memlimit_args
+                   for extra_solver in FLAGS.extra_solver],
         task=task,
         priority=900,
         data='extra',
         cgroup=None if FLAGS.disable_cgroup else CGROUP_NAME)
       jobs.append(job)
+  else:
+    for extra_solver in FLAGS.extra_solver:
+      for task in tasks:
+        job = supervisor_util.SolverJob(
+          args=[extra_solver] + memlimit_args,
+          task=task,
+          priority=900,
+          data='extra',
+          cgroup=None if FLAGS.disable_cgroup else CGROUP_NAME)
+        jobs.append(job)
+
+  if pipeline:
+    for job in jobs:
+      pipeline.watch(job)
 
   soft_deadline = deadline - 0.5
 
@@ -157,7 +307,10 @@ def run_solvers(tasks, num_threads, deadline):
     'Start solver phase: jobs=%d, soft_deadline=%.1fs hard_deadline=%.1fs',
     len(jobs), soft_deadline - start_time, deadline - start_time)
 
-  supervisor_util.run_generic_jobs(jobs, num_threads, soft_deadline, deadline)
+  supervisor_util.run_generic_jobs(
+    jobs, num_threads, soft_deadline, deadline, job_source=pipeline,
+    admission_check=make_admission_check(deadline))
+  supervisor_util.close_solver_workers()
   solutions = [job.solution for job in jobs if job.solution['_score'] > 0]
 
   end_time = time.time()
@@ -173,8 +326,7 @@ def run_rewriter(original_solutions, tasks, num_threads, deadline):
     logging.warning('Rewriter not available. Scores will suffer.')
     return []
 
-  rewriter_args = [FLAGS.rewriter]
-  rewriter_args.extend(['-p', ','.join(FLAGS.powerphrase)])
+  rewriter_args = make_rewriter_args()
 
   task_map = {}
   for task in tasks:
@@ -205,6 +357,7 @@ def run_rewriter(original_solutions, tasks, num_threads, deadline):
     len(jobs), soft_deadline - start_time, deadline - start_time)
 
   supervisor_util.run_generic_jobs(jobs, num_threads, soft_deadline, deadline)
+  supervisor_util.close_solver_workers()
   solutions = [job.solution for job in jobs if job.solution['_score'] > 0]
 
   end_time = time.time()
@@ -236,13 +389,30 @@ def solve_tasks(tasks, num_threads, deadline):
   now = time.time()
   time_to_deadline = deadline - now
   rewrite_time = min(max(3, 0.001 * task_size_total), time_to_deadline / 5)
+  pipeline = None
+  if FLAGS.enable_pipelined_rewriting and FLAGS.rewriter:
+    # Most results are rewritten during the solver phase, so the last phase
+    # only takes what came in at the end.
+    rewrite_time = min(3, time_to_deadline / 5)
+    pipeline = RewritePipeline(tasks)
   solver_deadline = deadline - rewrite_time
 
   known_solutions = load_state_of_the_art(tasks)
-  plain_solutions = run_solvers(tasks, num_threads, solver_deadline)
-  rewritten_solutions = run_rewriter(plain_solutions, tasks, num_threads, deadline)
+  plain_solutions = run_solvers(tasks, num_threads, solver_deadline, pipeline)
+  pipelined_solutions = []
+  rewrite_solutions = plain_solutions
+  if pipeline:
+    pipelined_solutions = [
+      job.solution for job in pipeline.rewriter_jobs
+      if job.solution['_score'] > 0]
+    rewrite_solutions = [
+      solution for solution in plain_solutions
+      if not pipeline.is_rewritten(solution)]
+  rewritten_solutions = run_rewriter(
+    rewrite_solutions, tasks, num_threads, deadline)
   return choose_best_solutions(
-    known_solutions + plain_solutions + rewritten_solutions, tasks)
+    known_solutions + plain_solutions + pipelined_solutions +
+    rewritten_solutions, tasks)
 
 
 def main(unused_argv):
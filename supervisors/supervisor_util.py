@@ -2,9 +2,11 @@ import collections
 import copy
 import errno
 import logging
+import mmap
 import os
 import Queue as queue
 import signal
+import struct
 import subprocess
 import tempfile
 import time
@@ -16,6 +18,25 @@ import ujson as json
 FLAGS = gflags.FLAGS
 
 gflags.DEFINE_bool('enable_hazuki_proxy', False, '')
+gflags.DEFINE_bool(
+  'enable_incremental_output', False,
+  'Let solvers report only the change of their solutions on request.')
+gflags.DEFINE_bool(
+  'enable_progress_channel', False,
+  'Read the progress of solvers from shared memory instead of signaling them.')
+gflags.DEFINE_bool(
+  'enable_solver_workers', False,
+  'Solve quick solver tasks on persistent --worker processes.')
+gflags.DEFINE_bool(
+  'enable_fan_in_proxy', False,
+  'Run the quick and extra solvers of a task under one hazuki_proxy.')
+gflags.DEFINE_bool(
+  'enable_adaptive_scheduling', False,
+  'While jobs are waiting for slots, interrupt the running jobs whose '
+  'scores improve the slowest to make room for them.')
+gflags.DEFINE_float(
+  'adaptive_window', 30.0,
+  'Seconds over which the improvement of a job is measured.')
 
 
 DEFAULT_PRIORITY = -1
@@ -29,13 +50,22 @@ class HazukiJobBase(object):
     self.priority = priority
     self.data = data
     self.size = task['width'] * task['height']
+    # Number of solver processes of the job, each using a core.
+    self.width = 1
     self._cgroup = cgroup
     self._proc = None
     self._reader_thread = None
     self.solution = make_sentinel_solution(self.problem_id, self.seed)
+    # The last solution reported, which incremental results apply to.
+    self._commands = u''
     self.returncode = None
     self.start_time = None
     self.end_time = None
+    # (time, best score) at each report of the job.
+    self.reports = []
+    # Guards solution, _commands and reports, which the reader and progress
+    # threads update.
+    self._solutions_lock = threading.Lock()
     self._finish_callbacks = []
 
   def register_finish_callback(self, callback):
@@ -61,6 +91,11 @@ class HazukiJobBase(object):
   def _make_process(self):
     raise NotImplementedError()
 
+  def skip(self):
+    """Finishes the job without starting it, keeping the sentinel solution."""
+    logging.debug('Skipping: %r', self)
+    self._call_callbacks()
+
   def interrupt(self):
     if not self._proc:
       logging.error('Attempted to interrupt an unstarted job: %r', self)
@@ -109,16 +144,7 @@ class HazukiJobBase(object):
           break
         if not line.strip():
           continue
-        solutions = json.loads(line)
-        for solution in solutions:
-          assert isinstance(solution['tag'], unicode)
-          assert isinstance(solution['solution'], unicode)
-          assert isinstance(solution['_score'], int)
-          if solution['_score'] > self.solution['_score']:
-            solution['problemId'] = self.problem_id
-            solution['seed'] = self.seed
-            self.solution = solution
-            logging.info('Got score=%d: %r', solution['_score'], self)
+        self._handle_solutions(json.loads(line))
     except Exception:
       logging.exception('Uncaught exception in output reader thread: %r', self)
 
@@ -132,6 +158,52 @@ class HazukiJobBase(object):
     logging.debug('Finished in %.3fs: %r', self.end_time - self.start_time, self)
     self._call_callbacks()
 
+  def _handle_solutions(self, solutions):
+    with self._solutions_lock:
+      for solution in solutions:
+        if '_keep' in solution:
+          self._commands = (
+            self._commands[:solution.pop('_keep')] + solution.pop('_append'))
+          solution['solution'] = self._commands
+        else:
+          self._commands = solution['solution']
+        self._update_solution(solution)
+      self.reports.append((time.time(), self.solution['_score']))
+
+  def _handle_progress(self, solution):
+    """Takes a result read from the progress channel. Incremental results
+    written to stdout do not apply to it, so self._commands is kept."""
+    with self._solutions_lock:
+      self._update_solution(solution)
+      self.reports.append((time.time(), self.solution['_score']))
+
+  def _update_solution(self, solution):
+    assert isinstance(solution['tag'], unicode)
+    assert isinstance(solution['solution'], unicode)
+    assert isinstance(solution['_score'], int)
+    if solution['_score'] > self.solution['_score']:
+      solution['problemId'] = self.problem_id
+      solution['seed'] = self.seed
+      self.solution = solution
+      logging.info('Got score=%d: %r', solution['_score'], self)
+
+  def improvement_rate(self, window):
+    """Returns the score gained per second in the last window seconds.
+
+    Returns None if the job has not been running for that long. A job which
+    has not reported in the window has a rate of 0.
+    """
+    since = time.time() - window
+    if self.start_time is None or self.start_time > since:
+      return None
+    reports = self.reports
+    base_score = 0
+    for report_time, score in reports:
+      if report_time > since:
+        break
+      base_score = score
+    return (self.solution['_score'] - base_score) / window
+
   def _call_callbacks(self):
     for callback in self._finish_callbacks:
       try:
@@ -140,12 +212,84 @@ class HazukiJobBase(object):
         logging.exception('Uncaught exception in finish callback: %r', self)
 
 
+def solver_args(args):
+  """Returns the command line of a solver with the common flags."""
+  real_args = list(args)
+  if FLAGS.enable_incremental_output:
+    real_args.append('--incremental_output')
+  return real_args
+
+
+class ProgressChannel(object):
+  """Reads the best solution a solver publishes with --progress_shm.
+
+  See simulator/progress_channel.h for the layout.
+  """
+
+  _HEADER = struct.Struct('<8sQqqqqqq')
+  _SEQUENCE = struct.Struct('<Q')
+  _MAX_READ_ATTEMPTS = 100
+
+  def __init__(self, path):
+    self._path = path
+    self._map = None
+
+  def read(self):
+    """Returns (score, commands), or None if nothing is published yet.
+
+    Also returns None if no consistent snapshot could be read.
+    """
+    if not self._map and not self._remap():
+      return None
+    # A solver killed while publishing leaves the sequence odd for good, so
+    # give up after a while.
+    for _ in xrange(self._MAX_READ_ATTEMPTS):
+      (_, sequence, _, _, score, length, _, _) = (
+        self._HEADER.unpack_from(self._map, 0))
+      if sequence & 1:
+        time.sleep(0.001)
+        continue
+      if self._HEADER.size + length > len(self._map):
+        # The file grew for longer commands.
+        if not self._remap():
+          return None
+        continue
+      commands = self._map[self._HEADER.size:self._HEADER.size + length]
+      if self._SEQUENCE.unpack_from(self._map, 8)[0] != sequence:
+        continue
+      if sequence == 0:
+        return None
+      return score, commands.decode('ascii')
+    return None
+
+  def _remap(self):
+    try:
+      with open(self._path, 'rb') as f:
+        new_map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    except (IOError, OSError, ValueError):
+      # The solver has not created the file yet.
+      return False
+    if len(new_map) < self._HEADER.size:
+      new_map.close()
+      return False
+    if self._map:
+      self._map.close()
+    self._map = new_map
+    return True
+
+  def close(self):
+    if self._map:
+      self._map.close()
+      self._map = None
+
+
 class SolverJob(HazukiJobBase):
   def __init__(self, args, task, priority=DEFAULT_PRIORITY, data=None, cgroup=None):
     super(SolverJob, self).__init__(task=task, priority=priority, data=data, cgroup=cgroup)
     self.args = args
     self.task = task
     self._signal_thread = None
+    self._progress_path = None
 
   def start(self):
     super(SolverJob, self).start()
@@ -154,7 +298,12 @@ class SolverJob(HazukiJobBase):
     self._signal_thread.start()
 
   def _make_process(self):
-    real_args = list(self.args)
+    real_args = solver_args(self.args)
+    if FLAGS.enable_progress_channel:
+      fd, self._progress_path = tempfile.mkstemp(prefix='hazuki_progress.')
+      os.close(fd)
+      real_args.append('--progress_shm=%s' % self._progress_path)
+      self.register_finish_callback(lambda job: os.unlink(job._progress_path))
     if FLAGS.enable_hazuki_proxy:
       real_args = [os.path.join(os.path.dirname(__file__), 'hazuki_proxy')] + real_args
     with tempfile.TemporaryFile() as f:
@@ -165,6 +314,9 @@ class SolverJob(HazukiJobBase):
       return subprocess.Popen(real_args, stdin=f, stdout=subprocess.PIPE)
 
   def _signal_thread_main(self):
+    if self._progress_path:
+      self._poll_progress_channel()
+      return
     try:
       while True:
         time.sleep(1)
@@ -175,11 +327,208 @@ class SolverJob(HazukiJobBase):
       else:
         logging.exception('Uncaught exception in signal thread: %r', self)
 
+  def _poll_progress_channel(self):
+    channel = ProgressChannel(self._progress_path)
+    try:
+      while self.end_time is None:
+        time.sleep(1)
+        progress = channel.read()
+        if progress and progress[0] > self.solution['_score']:
+          self._handle_progress({
+            'tag': unicode(os.path.basename(self.args[0])),
+            'solution': progress[1],
+            '_score': progress[0],
+          })
+    except Exception:
+      logging.exception('Uncaught exception in progress thread: %r', self)
+    channel.close()
+
   def __repr__(self):
     return '<SolverJob p%d/s%d pri=%d %s>' % (
       self.problem_id, self.seed, self.priority, os.path.basename(self.args[0]))
 
 
+class FanInSolverJob(SolverJob):
+  """Runs several solvers for a task under one hazuki_proxy.
+
+  The proxy reports only the best result of the solvers, so the job costs a
+  single process and pipe on this side however many solvers it has.
+  """
+
+  def __init__(self, args_list, task, priority=DEFAULT_PRIORITY, data=None, cgroup=None):
+    super(FanInSolverJob, self).__init__(
+      args=args_list[0], task=task, priority=priority, data=data, cgroup=cgroup)
+    self.args_list = args_list
+    self.width = len(args_list)
+
+  def _make_process(self):
+    real_args = [os.path.join(os.path.dirname(__file__), 'hazuki_proxy')]
+    for args in self.args_list:
+      if len(real_args) > 1:
+        real_args.append('--')
+      real_args.extend(solver_args(args))
+    with tempfile.TemporaryFile() as f:
+      json.dump(self.task, f)
+      f.flush()
+      f.seek(0)
+      return subprocess.Popen(real_args, stdin=f, stdout=subprocess.PIPE)
+
+  def __repr__(self):
+    return '<FanInSolverJob p%d/s%d pri=%d %s>' % (
+      self.problem_id, self.seed, self.priority,
+      '+'.join(os.path.basename(args[0]) for args in self.args_list))
+
+
+class SolverWorker(object):
+  """A solver process running with --worker, which solves tasks in turn."""
+
+  def __init__(self, args, cgroup=None):
+    self.key = (tuple(args), cgroup)
+    self.proc = subprocess.Popen(
+      solver_args(args) + ['--worker'], stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    if cgroup:
+      subprocess.call(
+        ['sudo', '-n', 'cgclassify', '-g', 'memory:%s' % cgroup,
+         str(self.proc.pid)])
+    self.num_tasks = 0
+    self._lock = threading.Lock()
+
+  def send(self, message):
+    with self._lock:
+      try:
+        self.proc.stdin.write(json.dumps(message) + '\n')
+        self.proc.stdin.flush()
+      except (IOError, ValueError):
+        pass
+
+  def close(self):
+    with self._lock:
+      self.proc.stdin.close()
+    self.proc.wait()
+
+  def kill(self):
+    try:
+      self.proc.send_signal(signal.SIGKILL)
+    except Exception:
+      pass
+
+
+_idle_workers = collections.defaultdict(list)
+_idle_workers_lock = threading.Lock()
+
+
+def _acquire_worker(args, cgroup):
+  with _idle_workers_lock:
+    workers = _idle_workers[(tuple(args), cgroup)]
+    if workers:
+      return workers.pop()
+  return SolverWorker(args, cgroup)
+
+
+def _release_worker(worker):
+  with _idle_workers_lock:
+    _idle_workers[worker.key].append(worker)
+
+
+def close_solver_workers():
+  with _idle_workers_lock:
+    workers = [w for ws in _idle_workers.values() for w in ws]
+    _idle_workers.clear()
+  for worker in workers:
+    worker.close()
+
+
+class SolverWorkerJob(HazukiJobBase):
+  """Same as SolverJob, but reuses an idle worker process of the solver.
+
+  The worker ends the results of a task with an empty list. Interrupts and
+  result requests are sent as control messages instead of signals.
+  """
+
+  def __init__(self, args, task, priority=DEFAULT_PRIORITY, data=None, cgroup=None):
+    super(SolverWorkerJob, self).__init__(task=task, priority=priority, data=data, cgroup=cgroup)
+    self.args = args
+    self._worker = None
+    self._task_index = None
+    self._done = threading.Event()
+    self._signal_thread = None
+
+  def start(self):
+    logging.debug('Starting: %r', self)
+    self._worker = _acquire_worker(self.args, self._cgroup)
+    self._task_index = self._worker.num_tasks
+    self._worker.num_tasks += 1
+    self.start_time = time.time()
+    self._worker.send(self.task)
+    self._reader_thread = threading.Thread(target=self._reader_thread_main)
+    self._reader_thread.daemon = True
+    self._reader_thread.start()
+    self._signal_thread = threading.Thread(target=self._signal_thread_main)
+    self._signal_thread.daemon = True
+    self._signal_thread.start()
+
+  def interrupt(self):
+    if not self._worker:
+      logging.error('Attempted to interrupt an unstarted job: %r', self)
+      return
+    logging.debug('Interrupting: %r', self)
+    self._worker.send({'control': 'interrupt', 'task': self._task_index})
+
+  def terminate(self):
+    if not self._worker:
+      logging.error('Attempted to terminate an unstarted job: %r', self)
+      return
+    logging.debug('Terminating: %r', self)
+    self._worker.kill()
+
+  def poll(self):
+    if not self._done.is_set():
+      return None
+    return self.wait()
+
+  def wait(self):
+    self._reader_thread.join()
+    return self.returncode
+
+  def _reader_thread_main(self):
+    try:
+      while True:
+        line = self._worker.proc.stdout.readline()
+        if not line:
+          # The worker died before finishing the task.
+          self.returncode = self._worker.proc.wait() or 1
+          break
+        if not line.strip():
+          continue
+        solutions = json.loads(line)
+        if not solutions:
+          self.returncode = 0
+          break
+        self._handle_solutions(solutions)
+    except Exception:
+      logging.exception('Uncaught exception in output reader thread: %r', self)
+
+    if self.returncode == 0:
+      _release_worker(self._worker)
+    else:
+      logging.warning(
+        'A worker abnormally finished with return code %r: %r',
+        self.returncode, self)
+      self._worker.kill()
+    self.end_time = time.time()
+    logging.debug('Finished in %.3fs: %r', self.end_time - self.start_time, self)
+    self._done.set()
+    self._call_callbacks()
+
+  def _signal_thread_main(self):
+    while not self._done.wait(1):
+      self._worker.send({'control': 'dump'})
+
+  def __repr__(self):
+    return '<SolverWorkerJob p%d/s%d pri=%d %s>' % (
+      self.problem_id, self.seed, self.priority, os.path.basename(self.args[0]))
+
+
 class RewriterJob(HazukiJobBase):
   def __init__(self, args, solution, task, priority=DEFAULT_PRIORITY, data=None, cgroup=None):
     super(RewriterJob, self).__init__(task=task, priority=priority, data=data, cgroup=cgroup)
@@ -212,13 +561,26 @@ class RewriterJob(HazukiJobBase):
       self.problem_id, self.seed, self.priority, os.path.basename(self.args[0]))
 
 
-def run_generic_jobs(jobs, num_threads, soft_deadline, hard_deadline):
+def run_generic_jobs(jobs, num_threads, soft_deadline, hard_deadline,
+                     job_source=None, admission_check=None):
+  """Runs jobs in order of priority, num_threads at a time.
+
+  If job_source is given, it is called every second and after each job
+  finishes, and the jobs it returns are run as well.
+
+  If admission_check is given, it is called with each job when its turn
+  comes, and the job is skipped unless it returns True.
+  """
   unstarted_jobs = list(jobs)
+  if job_source:
+    unstarted_jobs.extend(job_source())
   started_jobs = []
   finished_jobs = []
+  skipped_jobs = []
   job_order = []
   finish_queue = queue.Queue()
   soft_deadline_triggered = False
+  preempted_jobs = set()
 
   while started_jobs or (not soft_deadline_triggered and unstarted_jobs):
     # Interrupt jobs when soft deadline is passed.
@@ -232,14 +594,22 @@ def run_generic_jobs(jobs, num_threads, soft_deadline, hard_deadline):
 
     # Start jobs as many as possible.
     if not soft_deadline_triggered:
-      while unstarted_jobs and len(started_jobs) < num_threads:
+      while (unstarted_jobs and
+             sum(job.width for job in started_jobs) < num_threads):
         new_job = min(unstarted_jobs, key=lambda job: (job.priority, job.size))
         unstarted_jobs.remove(new_job)
+        if admission_check and not admission_check(new_job):
+          new_job.skip()
+          skipped_jobs.append(new_job)
+          continue
         new_job.register_finish_callback(lambda job: finish_queue.put(job))
         new_job.start()
         started_jobs.append(new_job)
         job_order.append(new_job)
 
+    if FLAGS.enable_adaptive_scheduling and not soft_deadline_triggered:
+      _preempt_stalled_jobs(started_jobs, unstarted_jobs, preempted_jobs)
+
     # Wait for job finish.
     now = time.time()
     if now < soft_deadline:
@@ -250,24 +620,33 @@ def run_generic_jobs(jobs, num_threads, soft_deadline, hard_deadline):
       timeout_hard = True
     else:
       break
+    if job_source or (FLAGS.enable_adaptive_scheduling and unstarted_jobs):
+      # Look at the progress of jobs again soon.
+      timeout = min(timeout, 1)
     try:
       finishing_job = finish_queue.get(timeout=timeout)
     except queue.Empty:
-      if timeout_hard:
+      if timeout_hard and time.time() >= hard_deadline:
         break
+      if job_source:
+        unstarted_jobs.extend(job_source())
       continue
     finishing_job.wait()
     started_jobs.remove(finishing_job)
     finished_jobs.append(finishing_job)
     finish_queue.task_done()
+    if job_source:
+      unstarted_jobs.extend(job_source())
 
   # Terminate orphan jobs.
   for job in started_jobs:
     job.terminate()
 
   logging.info(
-    'Job stats: %d finished, %d terminated, %d unstarted',
-    len(finished_jobs), len(started_jobs), len(unstarted_jobs))
+    'Job stats: %d finished (%d preempted), %d terminated, %d skipped, '
+    '%d unstarted',
+    len(finished_jobs), len(preempted_jobs), len(started_jobs),
+    len(skipped_jobs), len(unstarted_jobs))
 
   logging.debug('Job execution order:')
   for job in job_order:
@@ -276,6 +655,31 @@ def run_generic_jobs(jobs, num_threads, soft_deadline, hard_deadline):
     logging.debug('  %r score=%d time=%s', job, job.solution['_score'], cost_str)
 
 
+def _preempt_stalled_jobs(started_jobs, unstarted_jobs, preempted_jobs):
+  """Interrupts the running jobs improving the slowest, until the slots they
+  free cover the waiting jobs."""
+  demand = (sum(job.width for job in unstarted_jobs) -
+            sum(job.width for job in started_jobs if job in preempted_jobs))
+  if demand <= 0:
+    return
+  candidates = []
+  for job in started_jobs:
+    if job in preempted_jobs:
+      continue
+    rate = job.improvement_rate(FLAGS.adaptive_window)
+    if rate is not None:
+      candidates.append((rate, -job.priority, job))
+  # Less important jobs go first among the equally slow ones.
+  candidates.sort(key=lambda entry: entry[:2])
+  for rate, _, job in candidates:
+    if demand <= 0:
+      break
+    logging.info('Preempting at %.3f points/s: %r', rate, job)
+    job.interrupt()
+    preempted_jobs.add(job)
+    demand -= job.width
+
+
 def make_sentinel_solution(problem_id, seed):
   return {
     'problemId': problem_id,
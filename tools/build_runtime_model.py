@@ -0,0 +1,116 @@
+#!/usr/bin/python
+
+"""Benchmarks solvers and writes a model of their running time.
+
+Usage:
+tools/build_runtime_model.py --solver=ai/duralstarman/ds_3 \
+    --output=supervisors/runtime_model.json
+
+See supervisors/runtime_model.py for the model.
+"""
+
+import copy
+import glob
+import logging
+import os
+import signal
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+import gflags
+import logging_util
+import ujson as json
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'supervisors'))
+import runtime_model
+
+FLAGS = gflags.FLAGS
+
+gflags.DEFINE_multistring('solver', [], 'Path to solver.')
+gflags.MarkFlagAsRequired('solver')
+gflags.DEFINE_multistring(
+  'problem', [], 'Path to problem JSON. Defaults to problems/*.json.',
+  short_name='f')
+gflags.DEFINE_string('output', None, 'Path to the model file to write.')
+gflags.MarkFlagAsRequired('output')
+gflags.DEFINE_float(
+  'timeout', 60, 'Seconds before a run is interrupted. Interrupted runs '
+  'are kept in the samples but left out of the fit.')
+
+
+def run_solver(solver, task):
+  """Returns the seconds the solver took on the task, and whether it timed
+  out."""
+  with tempfile.TemporaryFile() as f:
+    json.dump(task, f)
+    f.flush()
+    f.seek(0)
+    with open(os.devnull, 'w') as devnull:
+      start_time = time.time()
+      proc = subprocess.Popen(
+        [solver], stdin=f, stdout=devnull, stderr=devnull)
+      timer = threading.Timer(FLAGS.timeout, proc.send_signal, [signal.SIGINT])
+      timer.start()
+      proc.wait()
+      timer.cancel()
+      seconds = time.time() - start_time
+  return seconds, seconds >= FLAGS.timeout
+
+
+def main(unused_argv):
+  logging_util.setup()
+
+  problem_paths = FLAGS.problem or sorted(glob.glob(
+    os.path.join(os.path.dirname(__file__), '..', 'problems', '*.json')))
+  tasks = []
+  for path in problem_paths:
+    with open(path) as f:
+      problem = json.load(f)
+    task = copy.copy(problem)
+    task['sourceSeeds'] = problem['sourceSeeds'][:1]
+    tasks.append(task)
+
+  models = {}
+  for solver in FLAGS.solver:
+    samples = []
+    for task in tasks:
+      seconds, timed_out = run_solver(solver, task)
+      logging.info(
+        '%s p%d: %dx%d, %d units, length %d: %.3fs%s',
+        os.path.basename(solver), task['id'], task['width'], task['height'],
+        len(task['units']), task['sourceLength'], seconds,
+        ' (timed out)' if timed_out else '')
+      samples.append({
+        'problemId': task['id'],
+        'width': task['width'],
+        'height': task['height'],
+        'units': len(task['units']),
+        'sourceLength': task['sourceLength'],
+        'seconds': seconds,
+        'timedOut': timed_out,
+      })
+    # The time of an interrupted run is only a lower bound of its time.
+    finished = [
+      (runtime_model.task_features(task), sample['seconds'] / task['sourceLength'])
+      for task, sample in zip(tasks, samples) if not sample['timedOut']]
+    if not finished:
+      logging.warning(
+        '%s: every run timed out, so it is left out of the model',
+        os.path.basename(solver))
+      continue
+    coefficients = runtime_model.fit(finished)
+    logging.info('%s: coefficients=%r', os.path.basename(solver), coefficients)
+    models[os.path.basename(solver)] = {
+      'coefficients': coefficients,
+      'samples': samples,
+    }
+
+  with open(FLAGS.output, 'w') as f:
+    json.dump(models, f, indent=2)
+
+
+if __name__ == '__main__':
+  sys.exit(main(FLAGS(sys.argv)))